@@ -0,0 +1,218 @@
+#include <kafe/kafe.hpp>
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <iostream>
+#include <limits>
+#include <string>
+#include <vector>
+
+/*
+    Compares the size and the decoding speed of the code of the bytecode, with
+    the arguments on 1 byte (4 after a Wide prefix) and with the previous
+    layout, where each argument took 2 bytes.
+    Usage: KafeBenchmarks [directory of .kafe files, tests/kafe by default]
+*/
+
+using namespace kafe::internal;
+
+namespace
+{
+    // code of a segment, in one of the layouts
+    struct Code
+    {
+        const std::uint8_t* data;
+        std::size_t instructions;
+    };
+
+    // the arguments of each op code, without calling argumentCount() in the loops
+    std::array<std::uint8_t, 256> argumentCounts()
+    {
+        std::array<std::uint8_t, 256> counts {};
+        for (std::size_t op = 0; op < static_cast<std::size_t>(Op::Count); ++op)
+            counts[op] = static_cast<std::uint8_t>(argumentCount(static_cast<Op>(op)));
+        return counts;
+    }
+
+    // the previous layout: every argument on 2 bytes
+    std::vector<std::uint8_t> fixedLayout(const Segment& segment)
+    {
+        std::vector<std::uint8_t> data;
+        for (const Instruction& inst : segment.code)
+        {
+            data.push_back(static_cast<std::uint8_t>(inst.op));
+            for (std::size_t i = 0; i < argumentCount(inst.op); ++i)
+            {
+                data.push_back(static_cast<std::uint8_t>(inst.args[i]));
+                data.push_back(static_cast<std::uint8_t>(inst.args[i] >> 8));
+            }
+        }
+        return data;
+    }
+
+    // sum of the arguments of all the instructions, with 2 bytes per argument
+    std::uint64_t decodeFixed(const std::vector<Code>& segments, const std::array<std::uint8_t, 256>& counts)
+    {
+        std::uint64_t sum = 0;
+        for (const Code& code : segments)
+        {
+            const std::uint8_t* pc = code.data;
+            for (std::size_t n = 0; n < code.instructions; ++n)
+            {
+                std::size_t count = counts[pc[0]];
+                for (std::size_t i = 0; i < count; ++i)
+                    sum += static_cast<std::uint32_t>(pc[1 + 2 * i] | pc[2 + 2 * i] << 8);
+                pc += 1 + 2 * count;
+            }
+        }
+        return sum;
+    }
+
+    // the same with the current layout, as the VM reads it
+    std::uint64_t decodeCompact(const std::vector<Code>& segments, const std::array<std::uint8_t, 256>& counts)
+    {
+        std::uint64_t sum = 0;
+        for (const Code& code : segments)
+        {
+            const std::uint8_t* pc = code.data;
+            for (std::size_t n = 0; n < code.instructions; ++n)
+            {
+                if (pc[0] == static_cast<std::uint8_t>(Op::Wide))
+                {
+                    ++pc;
+                    std::size_t count = counts[pc[0]];
+                    for (std::size_t i = 0; i < count; ++i)
+                        sum += static_cast<std::uint32_t>(pc[1 + 4 * i] | pc[2 + 4 * i] << 8 | pc[3 + 4 * i] << 16) |
+                               static_cast<std::uint32_t>(pc[4 + 4 * i]) << 24;
+                    pc += 1 + 4 * count;
+                }
+                else
+                {
+                    std::size_t count = counts[pc[0]];
+                    for (std::size_t i = 0; i < count; ++i)
+                        sum += pc[1 + i];
+                    pc += 1 + count;
+                }
+            }
+        }
+        return sum;
+    }
+
+    // nanoseconds per instruction for one round of Runs decodings
+    template <typename F>
+    double measure(F decode, std::size_t instructions, std::uint64_t& checksum)
+    {
+        constexpr std::size_t Runs = 200;
+
+        auto start = std::chrono::steady_clock::now();
+        for (std::size_t i = 0; i < Runs; ++i)
+            checksum += decode();
+        auto end = std::chrono::steady_clock::now();
+
+        return std::chrono::duration<double, std::nano>(end - start).count() / static_cast<double>(Runs * instructions);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    std::filesystem::path directory(argc > 1 ? argv[1] : "tests/kafe");
+
+    std::vector<std::vector<std::uint8_t>> files;
+    std::vector<std::vector<std::uint8_t>> fixedCodes;
+    std::vector<Code> compact;
+    std::vector<Code> fixed;
+    std::size_t instructions = 0;
+    std::size_t compactSize = 0;
+
+    for (const auto& entry : std::filesystem::directory_iterator(directory))
+    {
+        if (entry.path().extension() != ".kafe")
+            continue;
+
+        try
+        {
+            auto p = kafe::Parser::fromFile(entry.path().string());
+            p.parse();
+            files.push_back(p.generateBytecode());
+        }
+        catch (const std::runtime_error& e)
+        {
+            std::cout << "Skipping " << entry.path().string() << ": " << e.what() << std::endl;
+        }
+    }
+
+    for (const auto& file : files)
+    {
+        BytecodeView view = BytecodeView::read(file.data(), file.size());
+        Bytecode decoded = Bytecode::read(file.data(), file.size());
+
+        for (std::size_t i = 0; i < view.segments.size(); ++i)
+        {
+            const SegmentView& segment = view.segments[i];
+            compact.push_back(Code { segment.code, segment.size });
+            fixedCodes.push_back(fixedLayout(decoded.segments[i]));
+            instructions += segment.size;
+
+            // the size of the code of a segment is known once it is walked
+            const std::uint8_t* pc = segment.code;
+            for (std::size_t n = 0; n < segment.size; ++n)
+            {
+                bool wide = pc[0] == static_cast<std::uint8_t>(Op::Wide);
+                std::size_t count = argumentCount(static_cast<Op>(pc[wide ? 1 : 0]));
+                pc += wide ? 2 + 4 * count : 1 + count;
+            }
+            compactSize += static_cast<std::size_t>(pc - segment.code);
+        }
+    }
+
+    std::size_t fixedSize = 0;
+    for (std::size_t i = 0; i < fixedCodes.size(); ++i)
+    {
+        fixed.push_back(Code { fixedCodes[i].data(), compact[i].instructions });
+        fixedSize += fixedCodes[i].size();
+    }
+
+    if (instructions == 0)
+    {
+        std::cout << "No code found in " << directory.string() << std::endl;
+        return 1;
+    }
+
+    const auto counts = argumentCounts();
+    std::uint64_t fixedChecksum = 0;
+    std::uint64_t compactChecksum = 0;
+    /*
+        The rounds of both layouts alternate, so that a change of frequency or a busy
+        core hits both of them, and the fastest round of each is kept: the noise only
+        makes a round slower. The spread (slowest / fastest) tells if the gap matters.
+    */
+    constexpr std::size_t Rounds = 25;
+    double fixedTime = std::numeric_limits<double>::max();
+    double compactTime = std::numeric_limits<double>::max();
+    double fixedSlowest = 0;
+    double compactSlowest = 0;
+    for (std::size_t round = 0; round < Rounds; ++round)
+    {
+        double time = measure([&] { return decodeFixed(fixed, counts); }, instructions, fixedChecksum);
+        fixedTime = std::min(fixedTime, time);
+        fixedSlowest = std::max(fixedSlowest, time);
+
+        time = measure([&] { return decodeCompact(compact, counts); }, instructions, compactChecksum);
+        compactTime = std::min(compactTime, time);
+        compactSlowest = std::max(compactSlowest, time);
+    }
+
+    std::cout << files.size() << " files, " << instructions << " instructions" << "\n\n"
+              << "layout        code size   decoding (fastest of " << Rounds << " rounds, spread)" << "\n"
+              << "2 bytes       " << fixedSize << " B    " << fixedTime << " ns/instruction, x" << fixedSlowest / fixedTime << "\n"
+              << "1 byte/wide   " << compactSize << " B    " << compactTime << " ns/instruction, x" << compactSlowest / compactTime << "\n";
+
+    // using the sums, so that the decoding isn't optimized away
+    if (fixedChecksum == 0 || compactChecksum == 0)
+        std::cout << "Nothing was decoded" << std::endl;
+
+    return 0;
+}
@@ -0,0 +1,151 @@
+#include <kafe/kafe.hpp>
+#include <kafe/internal/md5.hpp>
+
+#include <cstdint>
+#include <filesystem>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+/*
+    Feeds the bytecode readers with mutated files: the bytecode of each .kafe
+    file gets a few bytes changed, removed or inserted after its header, then
+    its hash is fixed so that the tables and the code are really decoded.
+    Bytecode::read() and BytecodeView::read() must reject the same files with
+    a BytecodeError, and the accepted ones must be listed and written again.
+    Build it with -fsanitize=address,undefined to catch the reads out of bounds.
+    Usage: KafeFuzz [directory of .kafe files, tests/kafe by default] [mutations per file]
+*/
+
+using namespace kafe::internal;
+
+namespace
+{
+    struct Results
+    {
+        std::size_t accepted = 0;
+        std::size_t rejected = 0;
+        std::size_t failures = 0;
+    };
+
+    std::vector<std::uint8_t> mutate(std::vector<std::uint8_t> data, std::mt19937& rng)
+    {
+        std::size_t count = 1 + rng() % 4;
+        for (std::size_t i = 0; i < count && data.size() > Bytecode::HeaderSize; ++i)
+        {
+            std::size_t at = Bytecode::HeaderSize + rng() % (data.size() - Bytecode::HeaderSize);
+            switch (rng() % 3)
+            {
+                case 0:
+                    data[at] = static_cast<std::uint8_t>(rng());
+                    break;
+
+                case 1:
+                    data.erase(data.begin() + static_cast<std::ptrdiff_t>(at));
+                    break;
+
+                default:
+                    data.insert(data.begin() + static_cast<std::ptrdiff_t>(at), static_cast<std::uint8_t>(rng()));
+                    break;
+            }
+        }
+
+        // a wrong hash would stop the readers before the tables
+        MD5Digest hash = md5(data.data() + Bytecode::HeaderSize, data.size() - Bytecode::HeaderSize);
+        std::copy(hash.begin(), hash.end(), data.begin() + Bytecode::HeaderSize - 16);
+        return data;
+    }
+
+    void check(const std::vector<std::uint8_t>& data, Results& results)
+    {
+        bool viewAccepted = true;
+        try
+        {
+            BytecodeView::read(data.data(), data.size());
+        }
+        catch (const BytecodeError&)
+        {
+            viewAccepted = false;
+        }
+
+        try
+        {
+            Bytecode bytecode = Bytecode::read(data.data(), data.size());
+            std::ostringstream os;
+            bytecode.toString(os);
+
+            // what was accepted must be written back in a valid file
+            std::vector<std::uint8_t> written = bytecode.write();
+            Bytecode::read(written.data(), written.size());
+            ++results.accepted;
+
+            if (!viewAccepted)
+            {
+                ++results.failures;
+                std::cout << "Rejected by BytecodeView::read() only" << std::endl;
+            }
+        }
+        catch (const BytecodeError& e)
+        {
+            ++results.rejected;
+
+            if (viewAccepted)
+            {
+                ++results.failures;
+                std::cout << "Rejected by Bytecode::read() only: " << e.what() << std::endl;
+            }
+        }
+    }
+}
+
+int main(int argc, char** argv)
+{
+    std::filesystem::path directory(argc > 1 ? argv[1] : "tests/kafe");
+    std::size_t mutations = argc > 2 ? std::stoul(argv[2]) : 20000;
+
+    // always the same seed, a failure can be reproduced
+    std::mt19937 rng(42);
+    Results results;
+    std::size_t files = 0;
+
+    for (const auto& entry : std::filesystem::directory_iterator(directory))
+    {
+        if (entry.path().extension() != ".kafe")
+            continue;
+
+        std::vector<std::uint8_t> bytecode;
+        try
+        {
+            auto p = kafe::Parser::fromFile(entry.path().string());
+            p.parse();
+            bytecode = p.generateBytecode();
+        }
+        catch (const std::runtime_error& e)
+        {
+            std::cout << "Skipping " << entry.path().string() << ": " << e.what() << std::endl;
+            continue;
+        }
+        ++files;
+
+        for (std::size_t i = 0; i < mutations; ++i)
+            check(mutate(bytecode, rng), results);
+
+        // without fixing the hash, any change must be found
+        bytecode.back() ^= 1;
+        try
+        {
+            Bytecode::read(bytecode.data(), bytecode.size());
+            ++results.failures;
+            std::cout << "Wrong hash accepted for " << entry.path().string() << std::endl;
+        }
+        catch (const BytecodeError&)
+        {}
+    }
+
+    std::cout << files << " files, " << results.accepted << " mutations accepted, " << results.rejected << " rejected, "
+              << results.failures << " failures" << std::endl;
+
+    return results.failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,74 @@
+#ifndef kafe_internal_arena_hpp
+#define kafe_internal_arena_hpp
+
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace kafe
+{
+    namespace internal
+    {
+        /*
+            Bump allocator: objects are placed one after the other in big blocks,
+            and are all freed at once with the arena. The blocks never move, the
+            objects keep their address until the arena is destroyed or cleared.
+        */
+        class Arena
+        {
+        public:
+            explicit Arena(std::size_t blockSize=64 * 1024);
+            ~Arena();
+
+            Arena(Arena&& other) noexcept;
+            Arena& operator=(Arena&& other) noexcept;
+
+            Arena(const Arena&) = delete;
+            Arena& operator=(const Arena&) = delete;
+
+            void* allocate(std::size_t size, std::size_t align);
+
+            template <typename T, typename... Args>
+            T* make(Args&&... args)
+            {
+                T* object = new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+
+                // only the objects which need it are remembered to be destroyed
+                if constexpr (!std::is_trivially_destructible_v<T>)
+                    m_destructors.push_back(Destructor { object, [](void* p) { static_cast<T*>(p)->~T(); } });
+
+                return object;
+            }
+
+            // destroy all the objects and free the memory
+            void clear();
+
+            // take the blocks of another arena, its objects are then destroyed with this one
+            void adopt(Arena&& other);
+
+            // number of bytes given by allocate()
+            std::size_t getUsed();
+
+        private:
+            struct Destructor
+            {
+                void* object;
+                void (*destroy)(void*);
+            };
+
+            std::size_t m_blockSize;
+            std::vector<std::unique_ptr<std::byte[]>> m_blocks;
+            std::byte* m_current;  // first free byte in the last block
+            std::size_t m_left;    // free bytes after m_current
+            std::size_t m_used;
+            std::vector<Destructor> m_destructors;
+
+            void destroyAll();
+        };
+    }
+}
+
+#endif
@@ -0,0 +1,190 @@
+#ifndef kafe_internal_bytecode_hpp
+#define kafe_internal_bytecode_hpp
+
+#include <cstdint>
+#include <cstddef>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <variant>
+#include <vector>
+
+#ifndef KAFE_VERSION_MAJOR
+    #define KAFE_VERSION_MAJOR 0
+    #define KAFE_VERSION_MINOR 0
+    #define KAFE_VERSION_PATCH 0
+#endif
+
+namespace kafe
+{
+    namespace internal
+    {
+        // a bytecode file which couldn't be read: bad header, wrong hash, truncated or invalid table
+        struct BytecodeError : public std::runtime_error
+        {
+            BytecodeError(const std::string& what) :
+                std::runtime_error(what)
+            {}
+        };
+
+        /*
+            Instructions of the VM. It works on registers: each function has a fixed
+            number of them, its arguments being the first ones (after the instance
+            for a method or a constructor), so most operations read their operands
+            and write their result in one instruction.
+            Names are symbol indices, jump targets are byte offsets in the code of
+            the segment.
+            The arguments are written on 1 byte each, or on 4 bytes after a Wide
+            prefix when one of them doesn't fit.
+        */
+        enum class Op : std::uint8_t
+        {
+            LoadConst,    // a k: r[a] = constant k
+            Move,         // a b: r[a] = r[b]
+            LoadGlobal,   // a s: r[a] = global named s
+            StoreGlobal,  // s a: global named s = r[a]
+            GetField,     // a b i: r[a] = attribute i of the instance r[b]
+            SetField,     // a i b: attribute i of the instance r[a] = r[b]
+            Add,          // a b c: r[a] = r[b] + r[c]
+            Sub,
+            Mul,
+            Div,
+            Shl,
+            Shr,
+            Eq,
+            Ne,
+            Lt,
+            Le,
+            Gt,
+            Ge,
+            Neg,          // a b: r[a] = -r[b]
+            BitNot,       // a b: r[a] = ~r[b]
+            Not,          // a b: r[a] = not r[b]
+            Jump,         // t: go to t
+            JumpIfFalse,  // a t: go to t if r[a] is false
+            JumpIfTrue,   // a t: go to t if r[a] is true
+            Call,         // a s n: call the function named s with r[a]...r[a + n - 1], result in r[a]
+            CallMethod,   // a s n: call the method named s of r[a] with r[a + 1]...r[a + n], result in r[a]
+            New,          // a s n: new instance of the class named s built with r[a + 1]...r[a + n], in r[a]
+            Return,       // a: return r[a]
+            Wide,         // prefix, only in the files: the next instruction has its arguments on 4 bytes
+            Count
+        };
+
+        // number of arguments of an instruction
+        std::size_t argumentCount(Op op);
+        const char* opName(Op op);
+
+        // the constant type written before each value, the index of its type in Constant
+        enum class ConstantType : std::uint8_t
+        {
+            Nil,
+            Int,     // 8 bytes, two's complement
+            Float,   // 8 bytes, IEEE 754 double
+            String,  // index of the text in the symbols table
+            Bool     // 1 byte, 0 or 1
+        };
+
+        // value of a constant, a string being the index of its symbol
+        using Constant = std::variant<std::monostate, std::int64_t, double, std::uint32_t, bool>;
+
+        // used as a symbol or class index when there is none
+        constexpr std::uint32_t NoIndex = 0xffffffff;
+
+        struct Instruction
+        {
+            Op op;
+            std::uint32_t args[3];
+        };
+
+        struct Attribute
+        {
+            std::uint32_t name;   // symbol
+            std::uint32_t value;  // constant, the default value
+        };
+
+        struct ClassInfo
+        {
+            std::uint32_t name;  // symbol
+            std::vector<Attribute> attributes;
+        };
+
+        /*
+            Code of a function. The first segment of a bytecode runs the top-level
+            instructions, the methods and the constructor of a class (named after
+            the class) have the index of their class.
+        */
+        struct Segment
+        {
+            std::uint32_t name = NoIndex;  // symbol
+            std::uint32_t cls = NoIndex;
+            std::uint32_t arguments = 0;   // not counting the instance
+            std::uint32_t registers = 0;
+            // the jump targets are indices of instructions, and offsets once written
+            std::vector<Instruction> code;
+        };
+
+        /*
+            A compiled program, in the format of documentation/vm/bytecode.md.
+            The counts and the indices are stored with as many bytes as they
+            need, a table can hold up to 2^32 - 1 entries.
+        */
+        struct Bytecode
+        {
+            static constexpr std::size_t HeaderSize = 4 + 4 + 4 + 16;
+
+            std::uint8_t version[3] = { KAFE_VERSION_MAJOR, KAFE_VERSION_MINOR, KAFE_VERSION_PATCH };
+            std::uint32_t timestamp = 0;
+
+            std::vector<Constant> constants;
+            std::vector<std::string> symbols;
+            std::vector<ClassInfo> classes;
+            std::vector<Segment> segments;
+
+            // the file, its hash computed on everything after the header
+            std::vector<std::uint8_t> write() const;
+
+            /*
+                Decode a file, checking the header, the hash and every index.
+                Throw a BytecodeError if anything is wrong.
+            */
+            static Bytecode read(const std::uint8_t* data, std::size_t size);
+
+            // human readable listing of the tables and the code
+            void toString(std::ostream& os) const;
+        };
+
+        // a code segment left in the file, its jump targets being byte offsets from code
+        struct SegmentView
+        {
+            std::uint32_t name;
+            std::uint32_t cls;
+            std::uint32_t arguments;
+            std::uint32_t registers;
+            const std::uint8_t* code;
+            std::uint32_t size;  // number of instructions, not counting the prefixes
+        };
+
+        /*
+            The tables of a bytecode file, read in place: the symbols and the code
+            point into the data, which must outlive the view. This is all the VM
+            needs, the instructions aren't decoded.
+        */
+        struct BytecodeView
+        {
+            std::uint8_t version[3];
+            std::uint32_t timestamp;
+
+            std::vector<Constant> constants;
+            std::vector<std::string_view> symbols;
+            std::vector<ClassInfo> classes;
+            std::vector<SegmentView> segments;
+
+            // check everything like Bytecode::read(), without copying anything
+            static BytecodeView read(const std::uint8_t* data, std::size_t size);
+        };
+    }
+}
+
+#endif
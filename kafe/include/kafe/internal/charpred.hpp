@@ -4,150 +4,175 @@
 // file containing all the character predicates
 
 #include <string>
-#include <cctype>  // for isspace, isalnum, ...
+#include <cstdint>
 
 namespace kafe
 {
     namespace internal
     {
-        // Base for all the Character Predicates used by the parsers
-        // Those act as 'rules' for the parsers
-        struct CharPred
+        /*
+            Set of characters stored as a 256 bits table, so that testing a
+            character is a single lookup. It doesn't depend on the locale,
+            everything outside of ASCII is considered as a non-special character.
+        */
+        class CharTable
         {
-            // storing a name to identify the predicates in the parsers
-            const std::string name;
-
-            CharPred(const std::string& n) : name(n) {}
-            // the int c represents a character
-            virtual bool operator() (const int c) const = 0;
-        };
+        public:
+            constexpr CharTable() :
+                m_bits{0, 0, 0, 0}
+            {}
 
-        inline struct IsSpace : public CharPred
-        {
-            IsSpace() : CharPred("space") {}
-            virtual bool operator() (const int c) const override
+            // all the characters from first to last (included)
+            static constexpr CharTable range(unsigned char first, unsigned char last)
             {
-                return std::isspace(c) != 0;
+                CharTable t;
+                for (unsigned c = first; c <= last; ++c)
+                    t.m_bits[c / 64] |= std::uint64_t(1) << (c % 64);
+                return t;
             }
-        } IsSpace;
 
-        inline struct IsInlineSpace : public CharPred
-        {
-            IsInlineSpace() : CharPred("inline space") {}
-            virtual bool operator() (const int c) const override
+            // all the characters of the given string
+            static constexpr CharTable of(const char* chars)
             {
-                return (std::isspace(c) != 0) && (c != '\n') && (c != '\r');
+                CharTable t;
+                for (; *chars != '\0'; ++chars)
+                {
+                    unsigned c = static_cast<unsigned char>(*chars);
+                    t.m_bits[c / 64] |= std::uint64_t(1) << (c % 64);
+                }
+                return t;
             }
-        } IsInlineSpace;
 
-        inline struct IsDigit : public CharPred
-        {
-            IsDigit() : CharPred("digit") {}
-            virtual bool operator() (const int c) const override
+            constexpr bool contains(const int c) const
             {
-                return std::isdigit(c) != 0;
+                unsigned u = static_cast<unsigned char>(c);
+                return (m_bits[u / 64] >> (u % 64)) & 1;
             }
-        } IsDigit;
 
-        inline struct IsUpper : public CharPred
-        {
-            IsUpper() : CharPred("uppercase") {}
-            virtual bool operator() (const int c) const override
+            constexpr CharTable operator|(const CharTable& other) const
             {
-                return std::isupper(c) != 0;
+                CharTable t;
+                for (int i=0; i < 4; ++i)
+                    t.m_bits[i] = m_bits[i] | other.m_bits[i];
+                return t;
             }
-        } IsUpper;
 
-        inline struct IsLower : public CharPred
-        {
-            IsLower() : CharPred("lowercase") {}
-            virtual bool operator() (const int c) const override
+            constexpr CharTable operator~() const
             {
-                return std::islower(c) != 0;
+                CharTable t;
+                for (int i=0; i < 4; ++i)
+                    t.m_bits[i] = ~m_bits[i];
+                return t;
             }
-        } IsLower;
 
-        inline struct IsAlpha : public CharPred
-        {
-            IsAlpha() : CharPred("alphabetic") {}
-            virtual bool operator() (const int c) const override
-            {
-                return std::isalpha(c) != 0;
-            }
-        } IsAlpha;
+        private:
+            std::uint64_t m_bits[4];
+        };
 
-        inline struct IsAlnum : public CharPred
+        /*
+            Character Predicates used by the parsers, those act as 'rules' for the parsers.
+            A predicate is any type with:
+                constexpr bool operator() (const int c) const
+                std::string name() const
+            The name identifies the predicate in the parsers, it is only built
+            when an error is raised.
+        */
+
+        // predicate testing a class of characters
+        struct CharClass
         {
-            IsAlnum() : CharPred("alphanumeric") {}
-            virtual bool operator() (const int c) const override
+            CharTable table;
+            const char* n;
+
+            constexpr bool operator() (const int c) const
             {
-                return std::isalnum(c) != 0;
+                return table.contains(c);
             }
-        } IsAlnum;
 
-        inline struct IsPrint : public CharPred
-        {
-            IsPrint() : CharPred("printable") {}
-            virtual bool operator() (const int c) const override
+            std::string name() const
             {
-                return std::isprint(c) != 0;
+                return n;
             }
-        } IsPrint;
+        };
 
-        struct IsChar : public CharPred
+        inline constexpr CharClass IsSpace       { CharTable::of(" \t\n\v\f\r"), "space" };
+        inline constexpr CharClass IsInlineSpace { CharTable::of(" \t\v\f"), "inline space" };
+        inline constexpr CharClass IsDigit       { CharTable::range('0', '9'), "digit" };
+        inline constexpr CharClass IsHexDigit    { IsDigit.table | CharTable::range('a', 'f') | CharTable::range('A', 'F'), "hexadecimal digit" };
+        inline constexpr CharClass IsBinDigit    { CharTable::range('0', '1'), "binary digit" };
+        inline constexpr CharClass IsUpper       { CharTable::range('A', 'Z'), "uppercase" };
+        inline constexpr CharClass IsLower       { CharTable::range('a', 'z'), "lowercase" };
+        inline constexpr CharClass IsAlpha       { IsUpper.table | IsLower.table, "alphabetic" };
+        inline constexpr CharClass IsAlnum       { IsAlpha.table | IsDigit.table, "alphanumeric" };
+        inline constexpr CharClass IsWordChar    { IsAlnum.table | CharTable::of("_"), "alphanumeric or '_'" };
+        inline constexpr CharClass IsPrint       { CharTable::range(' ', '~'), "printable" };
+        inline constexpr CharClass IsAny         { ~CharTable(), "any" };
+
+        struct IsChar
         {
-            explicit IsChar(const char c) :
-                m_k(c), CharPred("'" + std::string(1, c) + "'")
+            constexpr explicit IsChar(const char c) :
+                m_k(c)
             {}
-            virtual bool operator() (const int c) const override
+
+            constexpr bool operator() (const int c) const
             {
                 return m_k == c;
             }
-        
+
+            std::string name() const
+            {
+                return "'" + std::string(1, m_k) + "'";
+            }
+
         private:
-            const int m_k;
+            const char m_k;
         };
 
-        struct IsEither : public CharPred
+        template <typename A, typename B>
+        struct IsEither
         {
-            explicit IsEither(const CharPred& a, const CharPred& b) :
-                m_a(a), m_b(b), CharPred("(" + a.name + " | " + b.name + ")")
+            constexpr explicit IsEither(const A& a, const B& b) :
+                m_a(a), m_b(b)
             {}
-            virtual bool operator() (const int c) const override
+
+            constexpr bool operator() (const int c) const
             {
                 return m_a(c) || m_b(c);
             }
-        
+
+            std::string name() const
+            {
+                return "(" + m_a.name() + " | " + m_b.name() + ")";
+            }
+
         private:
-            const CharPred& m_a;
-            const CharPred& m_b;
+            const A m_a;
+            const B m_b;
         };
 
-        struct IsNot : public CharPred
+        template <typename A>
+        struct IsNot
         {
-            explicit IsNot(const CharPred& a) :
-                m_a(a), CharPred("~" + a.name)
+            constexpr explicit IsNot(const A& a) :
+                m_a(a)
             {}
-            virtual bool operator() (const int c) const override
+
+            constexpr bool operator() (const int c) const
             {
                 return !m_a(c);
             }
-        
-        private:
-            const CharPred& m_a;
-        };
 
-        inline struct IsAny : public CharPred
-        {
-            IsAny() : CharPred("any") {}
-            virtual bool operator() (const int c) const override
+            std::string name() const
             {
-                return true;
+                return "~" + m_a.name();
             }
-        } IsAny;
 
-        const IsChar IsMinus('-');
+        private:
+            const A m_a;
+        };
+
+        inline constexpr IsChar IsMinus('-');
     }
 }
 
-#endif
\ No newline at end of file
+#endif
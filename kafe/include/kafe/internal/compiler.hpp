@@ -0,0 +1,133 @@
+#ifndef kafe_internal_compiler_hpp
+#define kafe_internal_compiler_hpp
+
+#include <kafe/internal/bytecode.hpp>
+#include <kafe/internal/node.hpp>
+
+#include <cstdint>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+namespace kafe
+{
+    namespace internal
+    {
+        // an instruction which can't be compiled, located by the span of its node
+        struct CompileError : public std::runtime_error
+        {
+            const Span span;
+
+            CompileError(const std::string& what, Span span) :
+                std::runtime_error(what), span(span)
+            {}
+        };
+
+        /*
+            Lower the AST of a program into bytecode, in a single walk.
+            The top-level instructions go to the first code segment, each function,
+            constructor and method gets its own one.
+            In a function, a name is looked up in the local variables (arguments
+            included), then in the attributes of the class, then in the globals.
+            Every local variable and temporary value gets a register, the ones of
+            a block being reused after it.
+        */
+        class Compiler
+        {
+        public:
+            // the program must outlive the compiler
+            explicit Compiler(const Program& program);
+
+            // throw a CompileError on the first instruction which can't be compiled
+            Bytecode compile();
+
+        private:
+            struct Local
+            {
+                std::uint32_t reg;
+                bool constant;
+            };
+
+            struct ClassScope
+            {
+                std::uint32_t index;
+                std::unordered_map<Symbol, std::uint32_t> attributes;  // name to attribute index
+                std::unordered_set<Symbol> methods;
+            };
+
+            const Program& m_program;
+            Bytecode m_bytecode;
+            // (type, bits) of a constant to its index: the floats are compared bit by bit (-0.0 isn't 0.0)
+            std::map<std::pair<std::size_t, std::uint64_t>, std::uint32_t> m_constants;
+            // text of a bytecode symbol to its index, the views point into the program
+            std::unordered_map<std::string_view, std::uint32_t> m_symbolIndices;
+            // program symbol to bytecode symbol + 1, 0 if it isn't in the table yet
+            std::vector<std::uint32_t> m_symbols;
+            // names defined with cst at the top level
+            std::unordered_set<Symbol> m_globalConstants;
+            std::unordered_map<Symbol, ClassScope> m_classes;
+
+            // state of the segment being compiled
+            Segment* m_segment;
+            const ClassScope* m_class;  // nullptr outside of a class
+            bool m_topLevel;
+            std::unordered_map<Symbol, Local> m_locals;
+            std::uint32_t m_localCount;  // the registers below hold local variables
+            std::uint32_t m_top;         // first free register
+
+            // the node being compiled, to locate the errors
+            NodeRef m_node;
+
+            [[noreturn]] void error(const std::string& what);
+
+            std::uint32_t symbol(Symbol name);
+            // the text must live as long as the program (a name of its symbols, or a literal)
+            std::uint32_t symbol(std::string_view text);
+            std::uint32_t constant(const Constant& value);
+            // the value of a declaration without one
+            std::uint32_t defaultValue(Symbol type);
+            // the constant of a literal node, if it is one
+            bool literal(NodeRef node, std::uint32_t* index);
+
+            std::size_t emit(Op op, std::uint32_t a=0, std::uint32_t b=0, std::uint32_t c=0);
+            // make the jump instruction at the given index go to the next instruction
+            void patch(std::size_t jump);
+            std::uint32_t allocate();
+
+            void declareClass(NodeRef ref);
+            // start a new segment, with the given arguments in the first registers
+            void beginSegment(std::uint32_t name, const ClassScope* cls, NodeList arguments);
+            // add the return of nil, if the code doesn't already end with a ret
+            void endSegment(bool returns);
+            void compileFunction(NodeRef ref, const ClassScope* cls);
+            void compileClass(NodeRef ref);
+
+            void block(NodeList body);
+            void instruction(NodeRef ref);
+            // store the value of a register in a new variable of the current scope
+            void define(Symbol name, NodeRef value, bool constant);
+            void assign(Symbol name, Symbol op, NodeRef value);
+            void ifClause(NodeRef ref);
+
+            // compile an expression, its value going to the given register
+            void expression(NodeRef ref, std::uint32_t target);
+            // register holding the value of an expression: the one of a variable, or a new one
+            std::uint32_t operand(NodeRef ref);
+            /*
+                Call, CallMethod or New. The instance of a method call is the given
+                variable, or the instance of the current method if there is none.
+            */
+            void call(Op op, Symbol name, NodeList arguments, std::uint32_t target, const Symbol* instance);
+            void loadVariable(Symbol name, std::uint32_t target);
+            // index of an attribute of the current class
+            bool attribute(Symbol name, std::uint32_t* index);
+        };
+    }
+}
+
+#endif
@@ -0,0 +1,49 @@
+#ifndef kafe_internal_interner_hpp
+#define kafe_internal_interner_hpp
+
+#include <string_view>
+#include <vector>
+#include <cstdint>
+#include <kafe/internal/arena.hpp>
+
+namespace kafe
+{
+    namespace internal
+    {
+        // identifier of an interned string, the same string always gets the same symbol
+        using Symbol = std::uint32_t;
+
+        /*
+            Table of the distinct names of a program: each one is copied once
+            in an arena and gets a small symbol, starting at 0, so that comparing
+            two names is comparing two integers.
+            Lookups use an open addressing hash table with linear probing.
+        */
+        class Interner
+        {
+        public:
+            Interner();
+
+            Interner(Interner&&) = default;
+            Interner& operator=(Interner&&) = default;
+
+            // symbol of the given name, added to the table if it isn't there yet
+            Symbol intern(std::string_view name);
+            // the name stays valid as long as the interner
+            std::string_view name(Symbol symbol) const;
+            // number of distinct names
+            std::size_t size() const;
+
+        private:
+            Arena m_arena;
+            std::vector<std::string_view> m_names;  // by symbol
+            std::vector<std::uint32_t> m_hashes;    // by symbol, to avoid comparing the names when growing
+            std::vector<std::uint32_t> m_slots;     // symbol + 1, 0 for an empty slot
+
+            static std::uint32_t hash(std::string_view name);
+            void grow();
+        };
+    }
+}
+
+#endif
@@ -0,0 +1,98 @@
+#ifndef kafe_internal_lexer_hpp
+#define kafe_internal_lexer_hpp
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstdint>
+#include <kafe/internal/parser.hpp>
+
+namespace kafe
+{
+    namespace internal
+    {
+        enum class TokenType : std::uint8_t
+        {
+            Name,
+            Integer,     // 42, -42, 1_000, 0x2A, 0b101010
+            Float,       // 4.2, -4.2, 1_000.5
+            String,
+            Operator,    // +, -, *, /, <<, >>, ~, and, or, not, ==, !=, <, >, <=, >=
+            Assign,      // =
+            AssignOp,    // +=, -=, *=, /=
+            Colon,
+            Comma,
+            Dot,
+            LParen,
+            RParen,
+            Arrow,       // ->
+            NewLine,     // one token for a run of line ends and/or comments
+            EndOfFile,
+            Invalid,     // unexpected character or unterminated string
+
+            // keywords
+            Fun,
+            End,
+            Cst,
+            Cls,
+            New,
+            While,
+            Do,
+            If,
+            Elif,
+            Else,
+            Then,
+            True,
+            False,
+            Ret
+        };
+
+        // a token only points into the source, it doesn't copy anything
+        struct Token
+        {
+            TokenType type;
+            std::uint32_t offset;
+            std::uint32_t length;
+        };
+
+        using TokenList = std::vector<Token>;
+
+        /*
+            Turn a Kafe source into a flat list of tokens, in a single pass.
+            Spaces and comments are dropped, line ends are kept because
+            they terminate instructions. The lexer never fails, what it
+            can't recognize becomes an Invalid token.
+        */
+        class Lexer : public ParserCombinators
+        {
+        public:
+            Lexer(std::string_view code);
+            ~Lexer();
+
+            // the list always ends with an EndOfFile token
+            TokenList tokenize();
+
+        private:
+            TokenList m_tokens;
+
+            void push(TokenType type, std::size_t start);
+            // true if the last token can be the left hand side of a binary operator
+            bool previousIsOperand();
+
+            // custom parsers for tokens
+            bool inlineSpace();
+            bool endOfLine();
+            bool comment();
+            bool word();
+            bool numberLiteral();
+            // digits of the given class, possibly separated by single '_'
+            bool digits(const CharClass& digit);
+            // '0', the letter, then digits of the given class
+            bool prefixedDigits(char letter, const CharClass& digit);
+            bool stringLiteral();
+            bool symbol();
+        };
+    }
+}
+
+#endif
@@ -0,0 +1,41 @@
+#ifndef kafe_internal_lineindex_hpp
+#define kafe_internal_lineindex_hpp
+
+#include <string_view>
+#include <vector>
+#include <cstddef>
+
+namespace kafe
+{
+    namespace internal
+    {
+        struct Position
+        {
+            int row;  // starting at 1
+            int col;  // starting at 1, in bytes
+        };
+
+        /*
+            Offsets of the beginning of each line of a source, to turn a byte
+            offset into a row and a column only when it is needed (errors, node
+            locations...). The index is built on first use.
+        */
+        class LineIndex
+        {
+        public:
+            // the string isn't copied, it must outlive the index
+            explicit LineIndex(std::string_view source);
+
+            Position position(std::size_t offset);
+
+        private:
+            std::string_view m_source;
+            std::vector<std::size_t> m_starts;
+            bool m_built;
+
+            void build();
+        };
+    }
+}
+
+#endif
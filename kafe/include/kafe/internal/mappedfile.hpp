@@ -0,0 +1,42 @@
+#ifndef kafe_internal_mappedfile_hpp
+#define kafe_internal_mappedfile_hpp
+
+#include <string>
+#include <string_view>
+
+namespace kafe
+{
+    namespace internal
+    {
+        /*
+            Read-only view of a whole file, memory-mapped so that nothing is copied.
+            The view stays at the same address when the object is moved.
+            Throw a std::runtime_error if the file can't be opened or mapped.
+        */
+        class MappedFile
+        {
+        public:
+            explicit MappedFile(const std::string& path);
+            ~MappedFile();
+
+            MappedFile(MappedFile&& other) noexcept;
+            MappedFile& operator=(MappedFile&& other) noexcept;
+
+            MappedFile(const MappedFile&) = delete;
+            MappedFile& operator=(const MappedFile&) = delete;
+
+            std::string_view view() const;
+
+        private:
+            const char* m_data;
+            std::size_t m_size;
+#ifdef _WIN32
+            void* m_mapping;  // HANDLE of the file mapping object
+#endif
+
+            void unmap();
+        };
+    }
+}
+
+#endif
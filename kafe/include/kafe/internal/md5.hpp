@@ -0,0 +1,22 @@
+#ifndef kafe_internal_md5_hpp
+#define kafe_internal_md5_hpp
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+namespace kafe
+{
+    namespace internal
+    {
+        using MD5Digest = std::array<std::uint8_t, 16>;
+
+        /*
+            MD5 hash of a buffer (RFC 1321), used to check that a bytecode
+            file wasn't truncated or corrupted. Not meant for security.
+        */
+        MD5Digest md5(const std::uint8_t* data, std::size_t size);
+    }
+}
+
+#endif
@@ -1,120 +1,157 @@
 #ifndef kafe_internal_node_hpp
 #define kafe_internal_node_hpp
 
-#include <string>
 #include <vector>
-#include <memory>
+#include <cstdint>
 #include <iostream>
+#include <string_view>
+#include <type_traits>
+#include <kafe/internal/arena.hpp>
+#include <kafe/internal/interner.hpp>
 
 namespace kafe
 {
     namespace internal
     {
-        // base for all the nodes of the AST (Abstract Syntax Tree) of a Kafe program
-        struct Node
-        {
-            Node(const std::string& nodename);
+        class Program;
 
-            const std::string nodename;
+        // index of a node in its program
+        using NodeRef = std::uint32_t;
 
-            virtual void toString(std::ostream& os, std::size_t indent) = 0;
+        // list of children: a slice of the references stored by the program
+        struct NodeList
+        {
+            std::uint32_t begin = 0;
+            std::uint32_t count = 0;
         };
 
-        using NodePtr = std::shared_ptr<Node>;
-        using NodePtrList = std::vector<NodePtr>;
+        // one per type of node, to know which one is behind a Node&
+        enum class NodeKind : std::uint8_t
+        {
+            Declaration,
+            Definition,
+            ConstDef,
+            Assignment,
+            Function,
+            Class,
+            IfClause,
+            WhileLoop,
+            Integer,
+            Float,
+            String,
+            Bool,
+            VarUse,
+            BinaryOp,
+            UnaryOp,
+            FunctionCall,
+            MethodCall,
+            ClassInstanciation,
+            ClsConstructor,
+            End,
+            Elif,
+            Else,
+            Ret
+        };
 
-        // basic class to hold all the sub-nodes
-        struct Program : public Node
+        /*
+            Location of a node in its source, packed in 8 bytes: the file, the offset
+            of the first byte and the length in bytes. Longer nodes get MaxLength.
+            The row and the column are computed from the offset with a LineIndex.
+        */
+        struct Span
         {
-            Program();
+            static constexpr std::uint32_t MaxLength = (1u << 20) - 1;
+            static constexpr std::uint32_t MaxFile = (1u << 12) - 1;
 
-            /*
-                To add a Node to a program:
-                program.append<NodeType>(arg1, arg2);
-            */
-            template <typename T, typename... Args>
-            void append(Args&&... args)
-            {
-                children.push_back(
-                    std::move(
-                        std::make_shared<T>(std::forward<Args>(args)...)
-                        )
-                    );
-            }
+            Span();
+            Span(std::uint32_t file, std::uint32_t offset, std::uint32_t length);
 
-            NodePtrList children;
+            std::uint32_t offset;
+            std::uint32_t length : 20;
+            std::uint32_t file : 12;
+        };
+
+        /*
+            Base for all the nodes of the AST (Abstract Syntax Tree) of a Kafe program.
+            There is no virtual function, use visit() to get the real node.
+        */
+        struct Node
+        {
+            Node(NodeKind kind);
 
-            virtual void toString(std::ostream& os, std::size_t indent);
+            const NodeKind kind;
+            // filled by the parser
+            Span span;
         };
 
         // Node handling declaration, i.e. varname: type
         struct Declaration : public Node
         {
-            Declaration(const std::string& varname, const std::string& type);
+            Declaration(Symbol varname, Symbol type);
 
-            const std::string varname;
-            const std::string type;
+            Symbol varname;
+            Symbol type;
 
-            virtual void toString(std::ostream& os, std::size_t indent);
+            void toString(const Program& program, std::ostream& os, std::size_t indent) const;
         };
 
         // Node handling definition, i.e. varname: type = value
         struct Definition : public Node
         {
-            Definition(const std::string& varname, const std::string& type, NodePtr value);
+            Definition(Symbol varname, Symbol type, NodeRef value);
 
-            const std::string varname;
-            const std::string type;
-            NodePtr value;
+            Symbol varname;
+            Symbol type;
+            NodeRef value;
 
-            virtual void toString(std::ostream& os, std::size_t indent);
+            void toString(const Program& program, std::ostream& os, std::size_t indent) const;
         };
 
         // Node handling constants: cst name: type = value
         struct ConstDef : public Node
         {
-            ConstDef(const std::string& varname, const std::string& type, NodePtr value);
+            ConstDef(Symbol varname, Symbol type, NodeRef value);
 
-            const std::string varname;
-            const std::string type;
-            NodePtr value;
+            Symbol varname;
+            Symbol type;
+            NodeRef value;
 
-            virtual void toString(std::ostream& os, std::size_t indent);
+            void toString(const Program& program, std::ostream& os, std::size_t indent) const;
         };
 
         struct Assignment : public Node
         {
-            Assignment(const std::string& varname, NodePtr value, const std::string& op);
+            Assignment(Symbol varname, NodeRef value, Symbol op);
 
-            const std::string varname;
-            NodePtr value;
-            const std::string op;
+            Symbol varname;
+            NodeRef value;
+            Symbol op;
 
-            virtual void toString(std::ostream& os, std::size_t indent);
+            void toString(const Program& program, std::ostream& os, std::size_t indent) const;
         };
 
         // Node handling function: fun name(arg1: A, arg2: B) -> C *body* end
         struct Function : public Node
         {
-            Function(const std::string& name, NodePtrList arguments, const std::string& type, NodePtrList body);
+            Function(Symbol name, NodeList arguments, Symbol type, NodeList body);
 
-            const std::string name;
-            NodePtrList arguments;  // should be a vector of declaration
-            const std::string type;
-            NodePtrList body;
+            Symbol name;
+            NodeList arguments;  // should be a vector of declaration
+            Symbol type;
+            NodeList body;
 
-            virtual void toString(std::ostream& os, std::size_t indent);
+            void toString(const Program& program, std::ostream& os, std::size_t indent) const;
         };
 
         struct Class : public Node
         {
-            Class(const std::string& name, NodePtr constructor, NodePtrList body);
+            Class(Symbol name, NodeRef constructor, NodeList body);
 
-            const std::string name;
-            NodePtr constructor;  // should be a function
-            NodePtrList body;  // should be a vector of functions/definitions/declarations
+            Symbol name;
+            NodeRef constructor;  // should be a function
+            NodeList body;  // should be a vector of functions/definitions/declarations
 
-            virtual void toString(std::ostream& os, std::size_t indent);
+            void toString(const Program& program, std::ostream& os, std::size_t indent) const;
         };
 
         /*
@@ -133,14 +170,14 @@ namespace kafe
         */
         struct IfClause : public Node
         {
-            IfClause(NodePtr condition, NodePtrList body, NodePtrList elifClause, NodePtrList elseClause);
+            IfClause(NodeRef condition, NodeList body, NodeList elifClause, NodeList elseClause);
 
-            NodePtr condition;
-            NodePtrList body;
-            NodePtrList elifClause;  // should be a vector of ifclause (acting as elifs)
-            NodePtrList elseClause;  // contains the body of the else clause
+            NodeRef condition;
+            NodeList body;
+            NodeList elifClause;  // should be a vector of ifclause (acting as elifs)
+            NodeList elseClause;  // contains the body of the else clause
 
-            virtual void toString(std::ostream& os, std::size_t indent);
+            void toString(const Program& program, std::ostream& os, std::size_t indent) const;
         };
 
         /*
@@ -152,21 +189,21 @@ namespace kafe
         */
         struct WhileLoop : public Node
         {
-            WhileLoop(NodePtr condition, NodePtrList body);
+            WhileLoop(NodeRef condition, NodeList body);
 
-            NodePtr condition;
-            NodePtrList body;
+            NodeRef condition;
+            NodeList body;
 
-            virtual void toString(std::ostream& os, std::size_t indent);
+            void toString(const Program& program, std::ostream& os, std::size_t indent) const;
         };
 
         struct Integer : public Node
         {
-            Integer(int n);
+            Integer(std::int64_t n);
 
-            const int value;
+            const std::int64_t value;
 
-            virtual void toString(std::ostream& os, std::size_t indent);
+            void toString(const Program& program, std::ostream& os, std::size_t indent) const;
         };
 
         struct Float : public Node
@@ -175,16 +212,17 @@ namespace kafe
 
             const float value;
 
-            virtual void toString(std::ostream& os, std::size_t indent);
+            void toString(const Program& program, std::ostream& os, std::size_t indent) const;
         };
 
         struct String : public Node
         {
-            String(const std::string& s);
+            String(std::string_view s);
 
-            const std::string value;
+            // stored by the program, see Program::text()
+            std::string_view value;
 
-            virtual void toString(std::ostream& os, std::size_t indent);
+            void toString(const Program& program, std::ostream& os, std::size_t indent) const;
         };
 
         struct Bool : public Node
@@ -193,78 +231,83 @@ namespace kafe
 
             const bool value;
 
-            virtual void toString(std::ostream& os, std::size_t indent);
+            void toString(const Program& program, std::ostream& os, std::size_t indent) const;
         };
 
         struct VarUse : public Node
         {
-            VarUse(const std::string& name);
+            VarUse(Symbol name);
 
-            const std::string name;
+            Symbol name;
 
-            virtual void toString(std::ostream& os, std::size_t indent);
+            void toString(const Program& program, std::ostream& os, std::size_t indent) const;
         };
 
-        struct Operator : public Node
+        // lhs op rhs, with op in +, -, *, /, <<, >>, and, or, ==, !=, <, >, <=, >=
+        struct BinaryOp : public Node
         {
-            Operator(const std::string& name);
+            BinaryOp(Symbol op, NodeRef lhs, NodeRef rhs);
 
-            const std::string name;
+            Symbol op;
+            NodeRef lhs;
+            NodeRef rhs;
 
-            virtual void toString(std::ostream& os, std::size_t indent);
+            void toString(const Program& program, std::ostream& os, std::size_t indent) const;
         };
 
-        struct OperationsList : public Node
+        // op operand, with op in -, ~, not
+        struct UnaryOp : public Node
         {
-            OperationsList(NodePtrList operations);
+            UnaryOp(Symbol op, NodeRef operand);
 
-            NodePtrList operations;
+            Symbol op;
+            NodeRef operand;
 
-            virtual void toString(std::ostream& os, std::size_t indent);
+            void toString(const Program& program, std::ostream& os, std::size_t indent) const;
         };
 
         struct FunctionCall : public Node
         {
-            FunctionCall(const std::string& name, NodePtrList arguments);
+            FunctionCall(Symbol name, NodeList arguments);
 
-            const std::string name;
-            NodePtrList arguments;
+            Symbol name;
+            NodeList arguments;
 
-            virtual void toString(std::ostream& os, std::size_t indent);
+            void toString(const Program& program, std::ostream& os, std::size_t indent) const;
         };
 
         struct MethodCall : public Node
         {
-            MethodCall(const std::string& classname, const std::string& funcname, NodePtrList arguments);
+            MethodCall(Symbol classname, Symbol funcname, NodeList arguments);
 
-            const std::string classname;
-            const std::string funcname;
-            NodePtrList arguments;
+            Symbol classname;
+            Symbol funcname;
+            NodeList arguments;
 
-            virtual void toString(std::ostream& os, std::size_t indent);
+            void toString(const Program& program, std::ostream& os, std::size_t indent) const;
         };
 
         // when we are creating a new instance of a class
         struct ClassInstanciation : public Node
         {
-            ClassInstanciation(const std::string& name, NodePtrList arguments);
+            ClassInstanciation(Symbol name, NodeList arguments);
 
-            const std::string name;
-            NodePtrList arguments;
+            Symbol name;
+            NodeList arguments;
 
-            virtual void toString(std::ostream& os, std::size_t indent);
+            void toString(const Program& program, std::ostream& os, std::size_t indent) const;
         };
 
         // the constructor of a class, handling its name, arguments and body
         struct ClsConstructor : public Node
         {
-            ClsConstructor(const std::string& name, NodePtrList arguments, NodePtrList body);
+            ClsConstructor(Symbol name, NodeList arguments, NodeList body);
 
-            const std::string name;
-            NodePtrList arguments;  // should be a vector of declarations
-            NodePtrList body;
+            Symbol name;
+            NodeList arguments;  // should be a vector of declarations
+            NodeList body;
 
-            virtual void toString(std::ostream& os, std::size_t indent);
+            void toString(const Program& program, std::ostream& os, std::size_t indent) const;
         };
 
         // shouldn't be in the AST
@@ -273,32 +316,222 @@ namespace kafe
         {
             End();
 
-            virtual void toString(std::ostream& os, std::size_t indent);
+            void toString(const Program& program, std::ostream& os, std::size_t indent) const;
         };
 
         struct Elif : public Node
         {
             Elif();
 
-            virtual void toString(std::ostream& os, std::size_t indent);
+            void toString(const Program& program, std::ostream& os, std::size_t indent) const;
         };
 
         struct Else : public Node
         {
             Else();
 
-            virtual void toString(std::ostream& os, std::size_t indent);
+            void toString(const Program& program, std::ostream& os, std::size_t indent) const;
         };
 
         // ret expression
         struct Ret : public Node
         {
-            Ret(NodePtr value);
+            Ret(NodeRef value);
+
+            NodeRef value;
+
+            void toString(const Program& program, std::ostream& os, std::size_t indent) const;
+        };
+
+        // ---------------------------
+
+        /*
+            Call the visitor with the real type of the node, eg:
+            visit(node, [](auto& n) { ... });
+            or with a struct having an operator() per type of node.
+        */
+        template <typename Visitor>
+        decltype(auto) visit(Node& node, Visitor&& visitor)
+        {
+            switch (node.kind)
+            {
+                case NodeKind::Declaration:        return visitor(static_cast<Declaration&>(node));
+                case NodeKind::Definition:         return visitor(static_cast<Definition&>(node));
+                case NodeKind::ConstDef:           return visitor(static_cast<ConstDef&>(node));
+                case NodeKind::Assignment:         return visitor(static_cast<Assignment&>(node));
+                case NodeKind::Function:           return visitor(static_cast<Function&>(node));
+                case NodeKind::Class:              return visitor(static_cast<Class&>(node));
+                case NodeKind::IfClause:           return visitor(static_cast<IfClause&>(node));
+                case NodeKind::WhileLoop:          return visitor(static_cast<WhileLoop&>(node));
+                case NodeKind::Integer:            return visitor(static_cast<Integer&>(node));
+                case NodeKind::Float:              return visitor(static_cast<Float&>(node));
+                case NodeKind::String:             return visitor(static_cast<String&>(node));
+                case NodeKind::Bool:               return visitor(static_cast<Bool&>(node));
+                case NodeKind::VarUse:             return visitor(static_cast<VarUse&>(node));
+                case NodeKind::BinaryOp:           return visitor(static_cast<BinaryOp&>(node));
+                case NodeKind::UnaryOp:            return visitor(static_cast<UnaryOp&>(node));
+                case NodeKind::FunctionCall:       return visitor(static_cast<FunctionCall&>(node));
+                case NodeKind::MethodCall:         return visitor(static_cast<MethodCall&>(node));
+                case NodeKind::ClassInstanciation: return visitor(static_cast<ClassInstanciation&>(node));
+                case NodeKind::ClsConstructor:     return visitor(static_cast<ClsConstructor&>(node));
+                case NodeKind::End:                return visitor(static_cast<End&>(node));
+                case NodeKind::Elif:               return visitor(static_cast<Elif&>(node));
+                case NodeKind::Else:               return visitor(static_cast<Else&>(node));
+                case NodeKind::Ret:                return visitor(static_cast<Ret&>(node));
+            }
+            // all the kinds are handled above
+            return visitor(static_cast<Ret&>(node));
+        }
+
+        // ---------------------------
+
+        // references of a child list, to iterate over them
+        struct NodeSlice
+        {
+            const NodeRef* first;
+            const NodeRef* last;
+
+            const NodeRef* begin() const { return first; }
+            const NodeRef* end() const { return last; }
+        };
+
+        /*
+            Root of the AST, owning all the nodes. They are allocated one after
+            the other in an arena and referenced by a 32 bits index, the child
+            lists are slices of a single array of references.
+            Everything is freed at once with the program.
+        */
+        class Program
+        {
+        public:
+            Program();
+
+            /*
+                To add a Node to a program:
+                NodeRef ref = program.make<NodeType>(arg1, arg2);
+            */
+            template <typename T, typename... Args>
+            NodeRef make(Args&&... args)
+            {
+                m_nodes.push_back(m_arena.make<T>(std::forward<Args>(args)...));
+                return static_cast<NodeRef>(m_nodes.size() - 1);
+            }
+
+            inline Node& get(NodeRef ref) const
+            {
+                return *m_nodes[ref];
+            }
+
+            template <typename T>
+            T& get(NodeRef ref) const
+            {
+                return static_cast<T&>(*m_nodes[ref]);
+            }
+
+            // store a complete list of children
+            NodeList list(const std::vector<NodeRef>& refs);
+            /*
+                Copy a text used by a node (eg a string literal), freed with the nodes
+                by clear(): unlike the symbols, they aren't kept by the next nodes.
+            */
+            std::string_view text(std::string_view s);
+            NodeSlice slice(NodeList list) const;
+
+            // number of nodes allocated
+            std::size_t size() const;
+
+            /*
+                Free all the nodes and child lists at once, their references become
+                invalid. The symbols are kept, they are shared by the next nodes.
+            */
+            void clear();
+
+            /*
+                Move all the nodes of another program after the ones of this program,
+                translating their references and symbols, and append its children.
+            */
+            void merge(Program&& other);
 
-            NodePtr value;
+            /*
+                The two halves of merge(), to translate several programs in parallel:
+                - the symbols of this program in the other one (added to it if needed)
+                - translate the references and symbols of the nodes, for a program
+                  appended after the given number of nodes and child list references
+                - move the nodes of a program already translated after the ones of this program
+            */
+            std::vector<Symbol> symbolsIn(Interner& other) const;
+            void relocate(NodeRef nodes, std::uint32_t lists, const std::vector<Symbol>& symbols);
+            void append(Program&& other);
+
+            // number of references in all the child lists
+            std::size_t listsSize() const;
+
+            void toString(std::ostream& os, std::size_t indent);
+            void toString(NodeRef node, std::ostream& os, std::size_t indent) const;
+
+            // the instructions at the top level
+            std::vector<NodeRef> children;
+            // the names used by the nodes
+            Interner symbols;
 
-            virtual void toString(std::ostream& os, std::size_t indent);
+        private:
+            Arena m_arena;
+            std::vector<Node*> m_nodes;
+            std::vector<NodeRef> m_lists;
         };
+
+        /*
+            Call f with the reference of each direct child of a node: values,
+            operands, conditions, arguments and bodies.
+        */
+        template <typename F>
+        void forEachChild(const Program& program, NodeRef ref, F&& f)
+        {
+            auto each = [&](NodeList list) {
+                for (NodeRef child : program.slice(list))
+                    f(child);
+            };
+
+            visit(program.get(ref), [&](auto& node) {
+                using T = std::decay_t<decltype(node)>;
+
+                if constexpr (std::is_same_v<T, Definition> || std::is_same_v<T, ConstDef> ||
+                              std::is_same_v<T, Assignment> || std::is_same_v<T, Ret>)
+                    f(node.value);
+                else if constexpr (std::is_same_v<T, Function> || std::is_same_v<T, ClsConstructor>)
+                {
+                    each(node.arguments);
+                    each(node.body);
+                }
+                else if constexpr (std::is_same_v<T, Class>)
+                {
+                    f(node.constructor);
+                    each(node.body);
+                }
+                else if constexpr (std::is_same_v<T, IfClause>)
+                {
+                    f(node.condition);
+                    each(node.body);
+                    each(node.elifClause);
+                    each(node.elseClause);
+                }
+                else if constexpr (std::is_same_v<T, WhileLoop>)
+                {
+                    f(node.condition);
+                    each(node.body);
+                }
+                else if constexpr (std::is_same_v<T, BinaryOp>)
+                {
+                    f(node.lhs);
+                    f(node.rhs);
+                }
+                else if constexpr (std::is_same_v<T, UnaryOp>)
+                    f(node.operand);
+                else if constexpr (std::is_same_v<T, FunctionCall> || std::is_same_v<T, MethodCall> ||
+                                   std::is_same_v<T, ClassInstanciation>)
+                    each(node.arguments);
+            });
+        }
     }
 }
 
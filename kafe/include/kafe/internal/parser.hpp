@@ -2,8 +2,10 @@
 #define kafe_internal_parser_hpp
 
 #include <string>
+#include <string_view>
 #include <stdexcept>
 #include <kafe/internal/charpred.hpp>
+#include <kafe/internal/lineindex.hpp>
 
 namespace kafe
 {
@@ -21,43 +23,77 @@ namespace kafe
             {}
         };
 
+        // same information as a ParseError, but collected instead of thrown
+        struct Diagnostic
+        {
+            std::string what;
+            int row;
+            int col;
+            std::string exp;
+            int sym;
+        };
+
         class ParserCombinators
         {
         public:
-            ParserCombinators(const std::string& s);
+            // state of the parser at a given point, to be able to go back to it
+            struct Checkpoint
+            {
+                std::size_t count;
+                int sym;
+            };
+
+            // the string isn't copied, it must outlive the parser
+            ParserCombinators(std::string_view s);
             ~ParserCombinators();
         
         private:
-            std::string m_in;
-            int m_count;
-            int m_row;
-            int m_col;
+            std::string_view m_in;
+            std::size_t m_count;
             int m_sym;
+            // rows and columns are only computed from the offset when needed
+            LineIndex m_lines;
 
             // getting next character and changing the values of count/row/col/sym
             void next();
+            // skipping n characters at once, the current one included
+            void advance(std::size_t n);
 
         protected:
             inline void error(const std::string& error, const std::string exp)
             {
-                throw ParseError(error, m_row, m_col, exp, m_sym);
+                throw ParseError(error, getRow(), getCol(), exp, m_sym);
             }
 
             // basic getters
             int getCol();
             int getRow();
-            int getCount();
+            std::size_t getCount();
             std::size_t getSize();
+            std::string_view getInput();
             bool isEOF();
 
-            void back(std::size_t n);
+            // saving and restoring the position in the string in constant time
+            Checkpoint save();
+            void restore(const Checkpoint& checkpoint);
 
             /*
                 Function to use and check if a Character Predicate was able to parse
                 the current symbol.
                 Add the symbol to the given string (if there was one) and call next()
             */
-            bool accept(const CharPred& t, std::string* s=nullptr);
+            template <typename CharPred>
+            bool accept(const CharPred& t, std::string* s=nullptr)
+            {
+                // return false if the predicate couldn't consume the symbol
+                if (!t(m_sym))
+                    return false;
+                // otherwise, add it to the string and go to the next symbol
+                if (s != nullptr)
+                    s->push_back(m_sym);
+                next();
+                return true;
+            }
 
             /*
                 Function to use and check if a Character Predicate was able to parse
@@ -65,7 +101,22 @@ namespace kafe
                 Add the symbol to the given string (if there was one) and call next().
                 Throw a ParseError if it couldn't.
             */
-            bool except(const CharPred& t, std::string* s=nullptr);
+            template <typename CharPred>
+            bool except(const CharPred& t, std::string* s=nullptr)
+            {
+                // throw an error if the predicate couldn't consume the symbol
+                // the name of the predicate is only needed here
+                if (!t(m_sym))
+                    error("Expected", t.name());
+                return accept(t, s);
+            }
+
+            /*
+                Consume in one go the run of symbols found by a scanner (see scan.hpp),
+                starting at the current symbol.
+                Add them to the given string (if there was one).
+            */
+            bool acceptRun(std::size_t (*scanner)(const char*, std::size_t), std::string* s=nullptr);
 
             // basic parsers
             bool space       (std::string* s=nullptr);
@@ -0,0 +1,176 @@
+#ifndef kafe_internal_runtime_hpp
+#define kafe_internal_runtime_hpp
+
+#include <kafe/internal/bytecode.hpp>
+#include <kafe/internal/mappedfile.hpp>
+
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace kafe
+{
+    class VM;
+
+    namespace internal
+    {
+        // an error while running the bytecode: wrong types, unknown name, division by zero...
+        struct RuntimeError : public std::runtime_error
+        {
+            RuntimeError(const std::string& what) :
+                std::runtime_error(what)
+            {}
+        };
+
+        enum class ValueType : std::uint8_t
+        {
+            Nil,
+            Int,
+            Float,
+            String,
+            Bool,
+            Instance
+        };
+
+        struct Object;
+        struct StringObject;
+        struct Instance;
+
+        // a value of the VM, on 16 bytes, the objects being owned by the VM
+        struct Value
+        {
+            ValueType type;
+            union
+            {
+                std::int64_t integer;
+                double real;
+                bool boolean;
+                StringObject* string;
+                Instance* instance;
+                Object* object;
+            };
+
+            Value() : type(ValueType::Nil), integer(0) {}
+            Value(std::int64_t i) : type(ValueType::Int), integer(i) {}
+            Value(double f) : type(ValueType::Float), real(f) {}
+            Value(bool b) : type(ValueType::Bool), integer(0) { boolean = b; }
+            Value(StringObject* s) : type(ValueType::String), string(s) {}
+            Value(Instance* i) : type(ValueType::Instance), instance(i) {}
+
+            // nil and false are false, everything else is true
+            bool isTrue() const
+            {
+                return type == ValueType::Bool ? boolean : type != ValueType::Nil;
+            }
+
+            bool isObject() const
+            {
+                return type == ValueType::String || type == ValueType::Instance;
+            }
+        };
+
+        /*
+            Base of the values allocated by the VM. They are chained together so
+            that the garbage collector can free the ones which weren't marked.
+        */
+        struct Object
+        {
+            Object(ValueType type) :
+                type(type), marked(false), next(nullptr)
+            {}
+
+            ValueType type;
+            bool marked;
+            Object* next;
+        };
+
+        struct StringObject : public Object
+        {
+            // a constant points to its symbol, the other strings to their storage
+            explicit StringObject(std::string_view text) :
+                Object(ValueType::String), text(text)
+            {}
+
+            explicit StringObject(std::string&& s) :
+                Object(ValueType::String), storage(std::move(s)), text(storage)
+            {}
+
+            std::string storage;
+            std::string_view text;
+        };
+
+        struct Module;
+        struct ClassData;
+        using Native = void (*)(VM& vm, Value* args, std::size_t count);
+
+        // a function of a module (a code segment), or a native one
+        struct FunctionData
+        {
+            std::string_view name;
+            const Module* module = nullptr;
+            const std::uint8_t* code = nullptr;
+            std::uint32_t arguments = 0;
+            std::uint32_t registers = 0;
+            // the class of a method or a constructor, nullptr for a function
+            const ClassData* cls = nullptr;
+            Native native = nullptr;
+        };
+
+        struct ClassData
+        {
+            std::string_view name;
+            std::vector<Value> defaults;  // value of each attribute of a new instance
+            const FunctionData* constructor = nullptr;
+            // the global slot of their name, and the method
+            std::vector<std::pair<std::uint32_t, const FunctionData*>> methods;
+        };
+
+        struct Instance : public Object
+        {
+            explicit Instance(const ClassData* cls) :
+                Object(ValueType::Instance), cls(cls), fields(cls->defaults)
+            {}
+
+            const ClassData* cls;
+            std::vector<Value> fields;
+        };
+
+        /*
+            A bytecode fed to the VM, with its tables ready to be used by the
+            instructions. The code and the names are read where they are in the
+            file, copied to data or mapped.
+        */
+        struct Module
+        {
+            std::vector<std::uint8_t> data;
+            std::optional<MappedFile> file;
+            BytecodeView bytecode;
+            std::vector<Value> constants;
+            // the strings of the constants, never collected nor moved
+            std::vector<StringObject> strings;
+            // global slot of each symbol
+            std::vector<std::uint32_t> slots;
+            std::vector<ClassData> classes;
+            // one per code segment, the first one running the top-level instructions
+            std::vector<FunctionData> functions;
+        };
+
+        // what a name refers to, shared by all the modules of the VM
+        struct Slot
+        {
+            std::string_view name;  // in a module, or kept by the VM
+            Value value;
+            bool defined = false;  // the global has a value
+            const FunctionData* function = nullptr;
+            const ClassData* cls = nullptr;
+        };
+    }
+}
+
+#endif
@@ -0,0 +1,40 @@
+#ifndef kafe_internal_scan_hpp
+#define kafe_internal_scan_hpp
+
+// file containing the vectorised scanners used by the lexer
+
+#include <cstddef>
+
+namespace kafe
+{
+    namespace internal
+    {
+        /*
+            Each scanner reads at most `size` characters from `data` and works
+            16 or 32 bytes at a time when SSE2 or AVX2 are available. The best
+            implementation is picked once at runtime, with a scalar fallback.
+        */
+        namespace scan
+        {
+            // length of the run of ' ', '\t', '\v' and '\f' at the start
+            std::size_t inlineSpaces(const char* data, std::size_t size);
+
+            // length of the run of alphanumeric characters and '_' at the start
+            std::size_t wordChars(const char* data, std::size_t size);
+
+            // number of characters before the first '\n'
+            std::size_t untilNewLine(const char* data, std::size_t size);
+
+            // number of characters before the first '"'
+            std::size_t untilQuote(const char* data, std::size_t size);
+
+            // number of '\n' in the given characters
+            std::size_t countNewLines(const char* data, std::size_t size);
+
+            // name of the implementation in use: "avx2", "sse2" or "scalar"
+            const char* implementation();
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,72 @@
+#ifndef kafe_internal_threadpool_hpp
+#define kafe_internal_threadpool_hpp
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace kafe
+{
+    namespace internal
+    {
+        /*
+            Work-stealing pool: each thread has its own queue of jobs. The jobs
+            submitted from outside are spread over the queues, the ones submitted
+            by a job go to the queue of its thread. A thread takes the last job of
+            its queue, and when it is empty, steals the oldest job of another one,
+            so that a few long jobs don't leave the other threads waiting.
+        */
+        class ThreadPool
+        {
+        public:
+            // 0 starts one thread per core
+            explicit ThreadPool(std::size_t threads=0);
+            // wait for the jobs already submitted, then stop the threads
+            ~ThreadPool();
+
+            ThreadPool(const ThreadPool&) = delete;
+            ThreadPool& operator=(const ThreadPool&) = delete;
+
+            void submit(std::function<void()> job);
+            /*
+                Wait until all the jobs are done, and rethrow the first exception
+                thrown by one of them, if any. Can't be called from a job.
+            */
+            void wait();
+
+            std::size_t size() const;
+
+        private:
+            struct Queue
+            {
+                std::mutex mutex;
+                std::deque<std::function<void()>> jobs;
+            };
+
+            std::vector<std::unique_ptr<Queue>> m_queues;  // one per thread
+            std::vector<std::thread> m_threads;
+            std::atomic<std::size_t> m_nextQueue;  // for the jobs submitted from outside
+            std::atomic<std::size_t> m_queued;     // jobs waiting in the queues
+
+            std::mutex m_mutex;
+            std::condition_variable m_jobAdded;
+            std::condition_variable m_jobsDone;
+            std::size_t m_pending;  // submitted and not finished yet
+            bool m_stopping;
+            std::exception_ptr m_error;
+
+            void work(std::size_t index);
+            // take a job from the queue of the given thread, or steal one
+            bool take(std::size_t index, std::function<void()>& job);
+        };
+    }
+}
+
+#endif
@@ -5,5 +5,7 @@
 // in order to to be able to only include this single file to have them all
 
 #include <kafe/parser.hpp>
+#include <kafe/project.hpp>
+#include <kafe/vm.hpp>
 
 #endif
\ No newline at end of file
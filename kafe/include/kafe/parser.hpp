@@ -2,80 +2,310 @@
 #define kafe_parser_hpp
 
 #include <kafe/internal/parser.hpp>
+#include <kafe/internal/lexer.hpp>
+#include <kafe/internal/mappedfile.hpp>
+#include <kafe/internal/compiler.hpp>
 #include <string>
+#include <string_view>
 #include <kafe/internal/node.hpp>
 #include <iostream>
 #include <optional>
+#include <memory>
+#include <vector>
+#include <functional>
 
 namespace kafe
 {
-    using MaybeNodePtr = std::optional<internal::NodePtr>;
+    using MaybeNodeRef = std::optional<internal::NodeRef>;
 
-    class Parser : private internal::ParserCombinators
+    class Parser
     {
     public:
-        Parser(const std::string& code);
+        // the code isn't copied, it must outlive the parser
+        Parser(std::string_view code);
+        Parser(const char* code);
+        // the parser takes ownership of the code, without copying it
+        Parser(std::string&& code);
         ~Parser();
 
+        Parser(Parser&&) = default;
+
+        // memory-map a file and parse it in place
+        static Parser fromFile(const std::string& path);
+
         void parse();
         void ASTtoString(std::ostream& os);
-    
+
+        /*
+            Compile the program into bytecode (documentation/vm/bytecode.md), after parse().
+            Throw a CompileError for an instruction which can't be compiled.
+        */
+        std::vector<std::uint8_t> generateBytecode();
+
+        /*
+            Streaming: parse the next top-level instruction and return it, as soon
+            as it is complete. It is also added to the children of the program.
+            Return an empty result at the end of the file, or when the parsing stopped
+            on an error.
+        */
+        MaybeNodeRef next();
+        /*
+            Free the nodes of all the instructions given by next() so far, so that
+            the memory used doesn't grow with the size of the file.
+        */
+        void release();
+        /*
+            Call the callback with each top-level instruction, as soon as it is parsed.
+            Its nodes are freed when the callback returns.
+        */
+        void parse(const std::function<void(internal::Program&, internal::NodeRef)>& callback);
+
+        // a part of the code replaced by another text
+        struct Edit
+        {
+            std::uint32_t offset;     // in bytes, where the replaced text starts
+            std::uint32_t oldLength;  // length of the replaced text
+            std::uint32_t newLength;  // length of the text inserted instead
+        };
+
+        /*
+            Incremental parsing, once the code given to the parser was edited: only
+            the top-level instructions touched by the edit are parsed again, the
+            other ones are kept as they are (only their spans are moved).
+            Everything is parsed again if the edited instructions have an error, or
+            if the previous parsing didn't reach the end of the code without error.
+            The nodes of the replaced instructions stay in the program, until they
+            are half of it: then everything is parsed again too, which
+            frees them, so the memory used stays within twice the size of the AST.
+            The new code isn't copied, it must outlive the parser.
+        */
+        void reparse(std::string_view code, const Edit& edit);
+
+        /*
+            Packrat mode: the results of the expression parsers are cached
+            by token position, so that nested expressions are parsed only once.
+            Must be set before calling parse().
+        */
+        void setPackrat(bool enabled);
+        /*
+            Number of times a cached result was used instead of parsing again,
+            since setPackrat() was called: the hits of reparse() are added to it.
+        */
+        std::size_t getPackratHits();
+
+        /*
+            Parallel mode: the code is split between top-level instructions and
+            the parts are parsed on the given number of threads (0 for one per
+            core), then put back together in order. The result is the same as
+            with a single thread, errors included. Must be set before calling parse().
+        */
+        void setThreads(std::size_t count);
+
+        enum class ErrorMode
+        {
+            Throw,    // throw a ParseError on the first error (default)
+            Collect,  // store the error as a diagnostic and stop parsing
+            Recover   // store every error as a diagnostic, skip the broken instructions
+        };
+
+        /*
+            In collect mode, no exception is thrown: the rules return an empty
+            result up to parse(), which is much cheaper when parsing incomplete
+            code all the time.
+            In recover mode, the parser skips to the next line (or to the matching
+            'end' for a block) after an error and keeps going: the program holds
+            everything that could be parsed.
+            Must be set before calling parse().
+        */
+        void setErrorMode(ErrorMode mode);
+        const std::vector<internal::Diagnostic>& getDiagnostics();
+
+        /*
+            Identifier of the parsed file, stored in the span of every node
+            (at most internal::Span::MaxFile). Must be set before calling parse().
+        */
+        void setFileId(std::uint32_t id);
+        // the AST, valid after parse()
+        internal::Program& getProgram();
+        // row and column of the beginning of a span of this file
+        internal::Position getPosition(const internal::Span& span);
+
     private:
+        // storage of the code, when the parser owns it
+        std::unique_ptr<std::string> m_ownedCode;
+        std::optional<internal::MappedFile> m_file;
+        std::string_view m_code;
+        internal::LineIndex m_lines;
+        internal::TokenList m_tokens;
+        std::size_t m_pos;  // index of the current token
         internal::Program m_program;
+        std::uint32_t m_fileId;
+
+        ErrorMode m_errorMode;
+        // set by an error, the rules must give up when they see it (collect/recover mode)
+        bool m_failed;
+        std::vector<internal::Diagnostic> m_diagnostics;
+
+        Parser(internal::MappedFile file);
+        // parse a part of the tokens of a code, already lexed
+        Parser(std::string_view code, internal::TokenList tokens);
+        // run the lexer on m_code
+        void lex();
+        // start parsing again from the first of the given tokens
+        void restart(internal::TokenList tokens);
 
-        inline bool isKeyword(const std::string& name)
+        /*
+            Parse again the instructions touched by an edit of the code, which was
+            oldSize bytes long. Return false if they have an error, the whole code
+            must then be parsed again.
+        */
+        bool reparseEdited(std::size_t oldSize, const Edit& edit);
+
+        /*
+            Token positions where the code can be split into the given number of parts
+            of similar sizes, all at the beginning of a top-level instruction. The first
+            one is always 0.
+        */
+        std::vector<std::size_t> topLevelSplits(std::size_t parts);
+        // parse on m_threads threads, return false (with an empty program) if a part has an error
+        bool parseParallel();
+        // move the span of a node and all its children by the given number of bytes
+        void moveSpans(internal::NodeRef node, std::int64_t delta);
+        // number of nodes in the tree of the given one, itself included
+        std::size_t nodeCount(internal::NodeRef node);
+
+        // rules whose results are cached in packrat mode
+        enum class PackratRule
         {
-            return (name == "fun" || name == "end" ||
-                    name == "cst" || name == "cls" ||
-                    name == "new" || name == "while" ||
-                    name == "do"  || name == "else" ||
-                    name == "if"  || name == "elif" ||
-                    name == "then" || name == "true" ||
-                    name == "false" || name == "ret");
-        }
+            Exp,
+            Operation,
+            SingleExp,
+            Count
+        };
 
-        inline bool isOperator(const std::string& name)
+        struct PackratEntry
         {
-            return (name == "+" || name == "-" ||
-                    name == "*" || name == "/" ||
-                    name == "<<" || name == "<<" ||
-                    name == "~" || name == "and" ||
-                    name == "or" || name == "not" ||
-                    name == "==" || name == "!=" ||
-                    name == "<" || name == ">" ||
-                    name == "<=" || name == ">=");
+            std::uint32_t epoch = 0;  // the entry is filled if it is m_packratEpoch
+            MaybeNodeRef result;
+            std::size_t end;  // position after the rule ran
+        };
+
+        bool m_packrat;
+        std::size_t m_packratHits;
+        // incremented by release(), the cached results refer to freed nodes
+        std::uint32_t m_packratEpoch;
+        // one entry per (rule, token position)
+        std::vector<PackratEntry> m_packratCache;
+
+        std::size_t m_threads;  // 0 for one per core
+        // nodes left unreachable in the program by reparse()
+        std::size_t m_garbageNodes;
+
+        // empty the cache, sized for the current tokens
+        void clearPackratCache();
+        // run the given parser, or reuse its previous result at the current position
+        MaybeNodeRef packrat(PackratRule rule, MaybeNodeRef (Parser::*parser)());
+
+        // precedence of the binary operator in the token (higher binds tighter), 0 if there is none
+        int binaryPrecedence(const internal::Token& token);
+        bool isUnaryOperator(const internal::Token& token);
+
+        /*
+            Report an error located on the current token: throw a ParseError,
+            or record it in collect mode. Always return an empty result so that
+            rules can `return error(...)`.
+        */
+        MaybeNodeRef error(const std::string& error, const std::string exp);
+
+        /*
+            Add a node to the program, its span going from the given offset
+            to the end of the last token read (line ends excluded).
+        */
+        template <typename T, typename... Args>
+        internal::NodeRef make(std::uint32_t begin, Args&&... args)
+        {
+            internal::NodeRef ref = m_program.make<T>(std::forward<Args>(args)...);
+            m_program.get(ref).span = spanFrom(begin, m_pos);
+            return ref;
         }
+        // span from the given offset to the end of the tokens before the given position
+        internal::Span spanFrom(std::uint32_t begin, std::size_t end);
+
+        // basic getters on the token stream
+        const internal::Token& current();
+        std::string_view text(const internal::Token& token);
+        bool isEOF();
+
+        /*
+            Function to check if the current token is of the given type.
+            Add its text to the given string (if there was one) and go to the next token.
+        */
+        bool accept(internal::TokenType type, std::string* s=nullptr);
+        // same, but give the symbol of the token text
+        bool accept(internal::TokenType type, internal::Symbol* symbol);
+
+        /*
+            Same as accept, but report an error if the token isn't of the given type.
+        */
+        bool except(internal::TokenType type, std::string* s=nullptr);
+
+        /*
+            Go back to the given token after a rule didn't match, to try another one.
+            Return false if the rule failed with an error instead (collect mode),
+            as there is nothing more to try.
+        */
+        bool backtrack(std::size_t position);
+
+        /*
+            In recover mode, skip the instruction starting at the given token which failed
+            (directly in the body of a class or not): up to the end of the line, or up to
+            its 'end' if it opens a block.
+            Return false if there is nothing to recover (other mode, or end of file reached).
+        */
+        bool recover(std::size_t start, bool classBody);
+        /*
+            True if the token opens a block closed by 'end' (fun, cls, if, constructor).
+            A constructor can only be directly in the body of a class, elsewhere a line
+            starting with 'new' is an instanciation.
+        */
+        bool isBlockStart(std::size_t position, bool classBody);
 
         // custom parsers for tokens
-        bool operator_(std::string* s=nullptr);
-        bool inlineSpace(std::string* s=nullptr);
-        bool endOfLine(std::string* s=nullptr);
-        bool comment(std::string* s=nullptr);
-        bool endOfLineAndOrComment(std::string* s=nullptr);
+        bool endOfLine();
 
         // parsers
-        MaybeNodePtr parseInstruction();
-        MaybeNodePtr parseDeclaration();
-        MaybeNodePtr parseConstDef();
-        MaybeNodePtr parseAssignment();
-        MaybeNodePtr parseExp();
-            MaybeNodePtr parseOperation();
-            MaybeNodePtr parseSingleExp();
-                MaybeNodePtr parseOperationBlock();
-                MaybeNodePtr parseInt();
-                MaybeNodePtr parseFloat();
-                MaybeNodePtr parseString();
-                MaybeNodePtr parseBool();
-                MaybeNodePtr parseClassInstanciation();
-                MaybeNodePtr parseFunctionCall();
-                MaybeNodePtr parseMethodCall();
-                MaybeNodePtr parseVarUse();
-        MaybeNodePtr parseEnd();
-        MaybeNodePtr parseFunction();
-        MaybeNodePtr parseClass();
-            MaybeNodePtr parseConstructor();
-        MaybeNodePtr parseRet();
-        MaybeNodePtr parseIf();
+        // parse the next instruction (of a class body or not), skipping the broken ones in recover mode
+        MaybeNodeRef parseInstructionOrRecover(bool classBody=false);
+        MaybeNodeRef parseInstruction();
+        MaybeNodeRef parseDeclaration();
+        MaybeNodeRef parseConstDef();
+        MaybeNodeRef parseAssignment();
+        MaybeNodeRef parseExp();
+        MaybeNodeRef parseExpUncached();
+            MaybeNodeRef parseOperation();
+            MaybeNodeRef parseOperationUncached();
+                MaybeNodeRef parseUnary();
+                // begin: offset of the left hand side in the source
+                MaybeNodeRef parseBinary(std::uint32_t begin, internal::NodeRef lhs, int minPrecedence);
+            MaybeNodeRef parseSingleExp();
+            MaybeNodeRef parseSingleExpUncached();
+                MaybeNodeRef parseOperationBlock();
+                MaybeNodeRef parseInt();
+                MaybeNodeRef parseFloat();
+                MaybeNodeRef parseString();
+                MaybeNodeRef parseBool();
+                MaybeNodeRef parseClassInstanciation();
+                MaybeNodeRef parseFunctionCall();
+                MaybeNodeRef parseMethodCall();
+                MaybeNodeRef parseVarUse();
+        MaybeNodeRef parseEnd();
+        MaybeNodeRef parseFunction();
+        MaybeNodeRef parseClass();
+            MaybeNodeRef parseConstructor();
+        MaybeNodeRef parseRet();
+        MaybeNodeRef parseIf();
+            MaybeNodeRef parseElif();
+            MaybeNodeRef parseElse();
     };
 }
 
@@ -0,0 +1,90 @@
+#ifndef kafe_project_hpp
+#define kafe_project_hpp
+
+#include <kafe/parser.hpp>
+#include <kafe/internal/node.hpp>
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace kafe
+{
+    /*
+        A set of Kafe files parsed together, concurrently, each one into its own
+        program. The top-level classes, functions and constants of all the files
+        are gathered in a single table. Everything is numbered in the order of
+        the files, whatever the order in which the threads finished.
+    */
+    class Project
+    {
+    public:
+        // the files are kept in the given order
+        explicit Project(std::vector<std::string> paths);
+        // all the .kafe files of a directory and its subdirectories, sorted by path
+        static Project fromDirectory(const std::string& path);
+
+        // number of threads parsing the files, 0 for one per core (default)
+        void setThreads(std::size_t count);
+        /*
+            Throw: the first error (in the order of the files) is thrown once all
+            the files were parsed, as a ParseError whose message starts with the path.
+            Collect/Recover: the errors are read with getDiagnostics(), as for a Parser.
+        */
+        void setErrorMode(Parser::ErrorMode mode);
+
+        void parse();
+
+        // an error of one of the files
+        struct Diagnostic
+        {
+            std::size_t file;
+            internal::Diagnostic diagnostic;
+        };
+
+        // parsing errors, then redefinitions of globals, in the order of the files
+        const std::vector<Diagnostic>& getDiagnostics();
+
+        struct Global
+        {
+            enum class Kind
+            {
+                Class,
+                Function,
+                Constant
+            };
+
+            std::string_view name;
+            Kind kind;
+            std::size_t file;
+            internal::NodeRef node;  // in the program of the file
+        };
+
+        // the top-level definitions of all the files, in the order of the files then of the code
+        const std::vector<Global>& getGlobals();
+        // nullptr if there is no such global
+        const Global* getGlobal(std::string_view name);
+
+        std::size_t size() const;
+        const std::string& getPath(std::size_t file);
+        // parser of a file, holding its program
+        Parser& getParser(std::size_t file);
+
+    private:
+        std::vector<std::string> m_paths;
+        std::vector<std::unique_ptr<Parser>> m_parsers;  // by file
+        std::size_t m_threads;
+        Parser::ErrorMode m_errorMode;
+
+        std::vector<Diagnostic> m_diagnostics;
+        std::vector<Global> m_globals;
+        std::unordered_map<std::string_view, std::size_t> m_globalsByName;  // index in m_globals
+
+        // fill the table of globals once all the files are parsed
+        void collectGlobals();
+    };
+}
+
+#endif
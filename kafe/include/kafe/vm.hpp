@@ -0,0 +1,253 @@
+#ifndef kafe_vm_hpp
+#define kafe_vm_hpp
+
+#include <kafe/internal/bytecode.hpp>
+#include <kafe/internal/runtime.hpp>
+#include <cstdint>
+#include <cstddef>
+#include <deque>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace kafe
+{
+    /*
+        Virtual machine running the bytecode made by Parser::generateBytecode().
+        Every call gets a window of registers in a single stack of values, starting
+        at the arguments given by the caller, so that nothing is copied to call a
+        function. The instructions are dispatched with computed gotos when the
+        compiler supports them (GCC, Clang), with a switch otherwise.
+    */
+    class VM
+    {
+    public:
+        /*
+            A global name resolved once by getHandle(), to call a function or read
+            a global without looking up its name again. It stays valid when the
+            name is defined (or defined again) by a file fed later.
+        */
+        class Handle
+        {
+        public:
+            Handle() : m_slot(0) {}
+
+        private:
+            friend class VM;
+            explicit Handle(std::uint32_t slot) : m_slot(slot) {}
+
+            std::uint32_t m_slot;
+        };
+
+        // the size of the stack is a number of values (registers)
+        explicit VM(std::size_t stackSize=64 * 1024);
+        ~VM();
+
+        VM(const VM&) = delete;
+        VM& operator=(const VM&) = delete;
+
+        /*
+            Load a bytecode file, which is copied. Its functions, classes and
+            globals join the ones of the bytecode fed before, a name can be used
+            in a file and defined in another one.
+            Throw a BytecodeError if the file is invalid.
+        */
+        void feed(const std::vector<std::uint8_t>& bytecode);
+        /*
+            Load a compiled file (usually a .kafec) without copying it: it is
+            mapped in memory, its code and its names being used where they are.
+            Throw a std::runtime_error if it can't be opened, a BytecodeError if
+            it is invalid.
+        */
+        void feedFile(const std::string& path);
+        // run the top-level instructions of the files fed since the last call, in order
+        void exec();
+
+        // the handle of a global name, which doesn't need to be defined yet
+        Handle getHandle(std::string_view name);
+
+        /*
+            Value of a global: bool, an integer or floating point type, std::string
+            or internal::Value.
+            Throw a RuntimeError if it isn't defined or doesn't have this type.
+        */
+        template <typename T>
+        T get(Handle global);
+        template <typename T>
+        T get(std::string_view name) { return get<T>(getHandle(name)); }
+
+        /*
+            Call a function with arguments of the types accepted by get() (and
+            const char*), which are put directly in its registers, and convert its
+            result. Can be called from a native function.
+            Throw a RuntimeError if the function doesn't exist, doesn't take this
+            number of arguments, fails, or if its result doesn't have the type R.
+        */
+        template <typename R=void, typename... Args>
+        R call(Handle function, Args&&... args);
+        template <typename R=void, typename... Args>
+        R call(std::string_view name, Args&&... args) { return call<R>(getHandle(name), std::forward<Args>(args)...); }
+
+        // where print() writes, std::cout by default
+        void setOutput(std::ostream& os);
+
+        // number of objects (strings, instances) currently allocated
+        std::size_t getObjectCount();
+        // free the objects which can't be reached anymore
+        void collectGarbage();
+
+    private:
+        // a call in progress, saved while it calls another function
+        struct Frame
+        {
+            const internal::FunctionData* function;
+            internal::Value* base;      // its first register
+            const std::uint8_t* pc;     // where to continue after the call
+            bool constructor;           // the call made by this one creates an instance
+        };
+
+        std::vector<internal::Value> m_stack;
+        // end of the registers of the running function, the ones above aren't used
+        internal::Value* m_top;
+        std::vector<Frame> m_frames;
+
+        std::vector<std::unique_ptr<internal::Module>> m_modules;
+        std::size_t m_executed;  // number of modules whose top-level code ran
+        std::vector<internal::Slot> m_slots;
+        std::unordered_map<std::string_view, std::uint32_t> m_slotIndices;
+        // the names of the slots which don't come from a module
+        std::deque<std::string> m_names;
+        std::vector<std::unique_ptr<internal::FunctionData>> m_natives;
+
+        // objects allocated by the VM, chained together
+        internal::Object* m_objects;
+        std::size_t m_objectCount;
+        // a collection is done when there are that many objects
+        std::size_t m_nextCollection;
+
+        std::ostream* m_output;
+
+        // add the tables of a bytecode to the ones of the VM, the data being kept by the module
+        void load(std::unique_ptr<internal::Module> module, const std::uint8_t* data, std::size_t size);
+        // slot of a global name, created if needed, the name must outlive the VM
+        std::uint32_t slot(std::string_view name);
+        void addNative(std::string_view name, internal::Native native);
+        static void print(VM& vm, internal::Value* args, std::size_t count);
+
+        // add an object to the ones collected, maybe after a collection
+        template <typename T, typename... Args>
+        T* allocate(Args&&... args);
+        void mark(std::vector<internal::Object*>& pending, internal::Value value);
+
+        // result of a binary operation, for the operands which aren't two integers
+        internal::Value binary(const internal::FunctionData* function, internal::Op op,
+                               const internal::Value& x, const internal::Value& y);
+
+        /*
+            Run a function whose registers start at the given value, the arguments
+            being already there, until it returns. Its result goes to base[0].
+        */
+        void execute(const internal::FunctionData* function, internal::Value* base);
+
+        [[noreturn]] void error(const internal::FunctionData* function, const std::string& what);
+
+        // the function of a slot and room for its arguments at m_top, or a RuntimeError
+        const internal::FunctionData* prepareCall(std::uint32_t slot, std::size_t count);
+        // run a function whose arguments were put at m_top
+        void finishCall(const internal::FunctionData* function, std::size_t count);
+        internal::Value makeString(std::string_view text);
+        [[noreturn]] void conversionError(std::uint32_t slot, const char* what, const char* type, const internal::Value& value);
+
+        template <typename T>
+        internal::Value toValue(T&& x);
+        // what is "Result of" or "Global", for the errors
+        template <typename T>
+        T fromValue(const internal::Value& value, std::uint32_t slot, const char* what);
+    };
+
+    template <typename T>
+    T VM::get(Handle global)
+    {
+        const internal::Slot& s = m_slots[global.m_slot];
+        if (!s.defined)
+            throw internal::RuntimeError("Undefined variable '" + std::string(s.name) + "'");
+        return fromValue<T>(s.value, global.m_slot, "Global");
+    }
+
+    template <typename R, typename... Args>
+    R VM::call(Handle function, Args&&... args)
+    {
+        const internal::FunctionData* fn = prepareCall(function.m_slot, sizeof...(Args));
+
+        // one by one above the registers in use, where the collector sees them
+        // if a string argument needs a collection
+        ((*m_top = toValue(std::forward<Args>(args)), ++m_top), ...);
+        finishCall(fn, sizeof...(Args));
+
+        // the result is in the first register, just above the ones in use
+        if constexpr (!std::is_void_v<R>)
+            return fromValue<R>(*m_top, function.m_slot, "Result of");
+    }
+
+    template <typename T>
+    internal::Value VM::toValue(T&& x)
+    {
+        using U = std::decay_t<T>;
+        if constexpr (std::is_same_v<U, internal::Value> || std::is_same_v<U, bool>)
+            return internal::Value(x);
+        else if constexpr (std::is_integral_v<U>)
+            return internal::Value(static_cast<std::int64_t>(x));
+        else if constexpr (std::is_floating_point_v<U>)
+            return internal::Value(static_cast<double>(x));
+        else
+        {
+            static_assert(std::is_convertible_v<T, std::string_view>, "Unsupported argument type");
+            return makeString(std::string_view(x));
+        }
+    }
+
+    template <typename T>
+    T VM::fromValue(const internal::Value& value, std::uint32_t slot, const char* what)
+    {
+        using internal::ValueType;
+
+        if constexpr (std::is_same_v<T, internal::Value>)
+            return value;
+        else if constexpr (std::is_same_v<T, bool>)
+        {
+            if (value.type == ValueType::Bool)
+                return value.boolean;
+            conversionError(slot, what, "bool", value);
+        }
+        else if constexpr (std::is_integral_v<T>)
+        {
+            if (value.type == ValueType::Int)
+                return static_cast<T>(value.integer);
+            conversionError(slot, what, "int", value);
+        }
+        else if constexpr (std::is_floating_point_v<T>)
+        {
+            // like in the scripts, an int can be used as a float
+            if (value.type == ValueType::Float)
+                return static_cast<T>(value.real);
+            if (value.type == ValueType::Int)
+                return static_cast<T>(value.integer);
+            conversionError(slot, what, "float", value);
+        }
+        else
+        {
+            // not a string_view, the string could be collected
+            static_assert(std::is_same_v<T, std::string>, "Unsupported result type");
+            if (value.type == ValueType::String)
+                return std::string(value.string->text);
+            conversionError(slot, what, "string", value);
+        }
+    }
+}
+
+#endif
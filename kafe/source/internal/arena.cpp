@@ -0,0 +1,115 @@
+#include <kafe/internal/arena.hpp>
+
+#include <cstdint>
+
+using namespace kafe::internal;
+
+Arena::Arena(std::size_t blockSize) :
+    m_blockSize(blockSize), m_current(nullptr), m_left(0), m_used(0)
+{}
+
+Arena::~Arena()
+{
+    destroyAll();
+}
+
+Arena::Arena(Arena&& other) noexcept :
+    m_blockSize(other.m_blockSize),
+    m_blocks(std::move(other.m_blocks)),
+    m_current(std::exchange(other.m_current, nullptr)),
+    m_left(std::exchange(other.m_left, 0)),
+    m_used(std::exchange(other.m_used, 0)),
+    m_destructors(std::move(other.m_destructors))
+{
+    other.m_blocks.clear();
+    other.m_destructors.clear();
+}
+
+Arena& Arena::operator=(Arena&& other) noexcept
+{
+    if (this != &other)
+    {
+        destroyAll();
+        m_blockSize = other.m_blockSize;
+        m_blocks = std::move(other.m_blocks);
+        m_current = std::exchange(other.m_current, nullptr);
+        m_left = std::exchange(other.m_left, 0);
+        m_used = std::exchange(other.m_used, 0);
+        m_destructors = std::move(other.m_destructors);
+
+        other.m_blocks.clear();
+        other.m_destructors.clear();
+    }
+    return *this;
+}
+
+void* Arena::allocate(std::size_t size, std::size_t align)
+{
+    std::size_t padding = (align - reinterpret_cast<std::uintptr_t>(m_current) % align) % align;
+
+    if (m_current == nullptr || padding + size > m_left)
+    {
+        // big objects get a block of their own, the current block stays in use
+        if (size + align > m_blockSize / 4)
+        {
+            m_blocks.push_back(std::unique_ptr<std::byte[]>(new std::byte[size + align]));
+            std::byte* block = m_blocks.back().get();
+            std::size_t offset = (align - reinterpret_cast<std::uintptr_t>(block) % align) % align;
+            m_used += size;
+            return block + offset;
+        }
+
+        // the memory isn't zeroed, the objects are constructed in place
+        m_blocks.push_back(std::unique_ptr<std::byte[]>(new std::byte[m_blockSize]));
+        m_current = m_blocks.back().get();
+        m_left = m_blockSize;
+        padding = (align - reinterpret_cast<std::uintptr_t>(m_current) % align) % align;
+    }
+
+    std::byte* p = m_current + padding;
+    m_current += padding + size;
+    m_left -= padding + size;
+    m_used += size;
+    return p;
+}
+
+void Arena::clear()
+{
+    destroyAll();
+
+    m_blocks.clear();
+    m_current = nullptr;
+    m_left = 0;
+    m_used = 0;
+}
+
+void Arena::adopt(Arena&& other)
+{
+    // the current block stays the last one, to keep on filling it
+    m_blocks.insert(
+        m_blocks.end() - (m_blocks.empty() ? 0 : 1),
+        std::make_move_iterator(other.m_blocks.begin()),
+        std::make_move_iterator(other.m_blocks.end())
+    );
+    m_destructors.insert(m_destructors.end(), other.m_destructors.begin(), other.m_destructors.end());
+    m_used += other.m_used;
+
+    other.m_blocks.clear();
+    other.m_destructors.clear();
+    other.m_current = nullptr;
+    other.m_left = 0;
+    other.m_used = 0;
+}
+
+std::size_t Arena::getUsed()
+{
+    return m_used;
+}
+
+void Arena::destroyAll()
+{
+    // in reverse order, like the destruction of local variables
+    for (auto it = m_destructors.rbegin(); it != m_destructors.rend(); ++it)
+        it->destroy(it->object);
+    m_destructors.clear();
+}
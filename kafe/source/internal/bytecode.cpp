@@ -0,0 +1,680 @@
+#include <kafe/internal/bytecode.hpp>
+#include <kafe/internal/md5.hpp>
+
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+
+using namespace kafe::internal;
+
+namespace
+{
+    struct OpInfo
+    {
+        const char* name;
+        std::size_t arguments;
+    };
+
+    // by op code
+    constexpr OpInfo Ops[] = {
+        { "LoadConst", 2 },
+        { "Move", 2 },
+        { "LoadGlobal", 2 },
+        { "StoreGlobal", 2 },
+        { "GetField", 3 },
+        { "SetField", 3 },
+        { "Add", 3 },
+        { "Sub", 3 },
+        { "Mul", 3 },
+        { "Div", 3 },
+        { "Shl", 3 },
+        { "Shr", 3 },
+        { "Eq", 3 },
+        { "Ne", 3 },
+        { "Lt", 3 },
+        { "Le", 3 },
+        { "Gt", 3 },
+        { "Ge", 3 },
+        { "Neg", 2 },
+        { "BitNot", 2 },
+        { "Not", 2 },
+        { "Jump", 1 },
+        { "JumpIfFalse", 2 },
+        { "JumpIfTrue", 2 },
+        { "Call", 3 },
+        { "CallMethod", 3 },
+        { "New", 3 },
+        { "Return", 1 },
+        { "Wide", 0 }
+    };
+    static_assert(sizeof(Ops) / sizeof(Ops[0]) == static_cast<std::size_t>(Op::Count), "an op is missing");
+
+    // size of an encoded instruction, with its prefix if it is wide
+    std::size_t instructionSize(Op op, bool wide)
+    {
+        return wide ? 2 + 4 * argumentCount(op) : 1 + argumentCount(op);
+    }
+
+    std::uint32_t load32(const std::uint8_t* data)
+    {
+        return static_cast<std::uint32_t>(data[0]) | static_cast<std::uint32_t>(data[1]) << 8 |
+               static_cast<std::uint32_t>(data[2]) << 16 | static_cast<std::uint32_t>(data[3]) << 24;
+    }
+
+    // index of the argument holding the jump target, argumentCount() if there is none
+    std::size_t targetArgument(Op op)
+    {
+        switch (op)
+        {
+            case Op::Jump:        return 0;
+            case Op::JumpIfFalse:
+            case Op::JumpIfTrue:  return 1;
+            default:              return argumentCount(op);
+        }
+    }
+
+    class Writer
+    {
+    public:
+        void u8(std::uint8_t value)
+        {
+            m_data.push_back(value);
+        }
+
+        // 7 bits per byte, the lowest ones first, the highest bit being set when another byte follows
+        void varint(std::uint64_t value)
+        {
+            while (value >= 0x80)
+            {
+                m_data.push_back(static_cast<std::uint8_t>(value | 0x80));
+                value >>= 7;
+            }
+            m_data.push_back(static_cast<std::uint8_t>(value));
+        }
+
+        // an index which may be NoIndex, written as 0, the other ones being shifted by 1
+        void index(std::uint32_t value)
+        {
+            varint(value == NoIndex ? 0 : static_cast<std::uint64_t>(value) + 1);
+        }
+
+        void u32(std::uint32_t value)
+        {
+            for (std::size_t i = 0; i < 4; ++i)
+                m_data.push_back(static_cast<std::uint8_t>(value >> (8 * i)));
+        }
+
+        void u64(std::uint64_t value)
+        {
+            for (std::size_t i = 0; i < 8; ++i)
+                m_data.push_back(static_cast<std::uint8_t>(value >> (8 * i)));
+        }
+
+        // a table size, which must fit on 4 bytes
+        void count(std::size_t value, const char* table)
+        {
+            if (value > 0xffffffff)
+                throw BytecodeError(std::string("Too many ") + table);
+            varint(value);
+        }
+
+        std::vector<std::uint8_t>& data()
+        {
+            return m_data;
+        }
+
+    private:
+        std::vector<std::uint8_t> m_data;
+    };
+
+    // bound-checked reading of a bytecode file
+    class Reader
+    {
+    public:
+        Reader(const std::uint8_t* data, std::size_t size) :
+            m_data(data), m_size(size), m_pos(0)
+        {}
+
+        std::uint8_t u8()
+        {
+            need(1);
+            return m_data[m_pos++];
+        }
+
+        std::uint32_t varint()
+        {
+            std::uint64_t value = 0;
+            for (std::size_t shift = 0; shift < 35; shift += 7)
+            {
+                std::uint8_t byte = u8();
+                value |= static_cast<std::uint64_t>(byte & 0x7f) << shift;
+                if ((byte & 0x80) == 0)
+                {
+                    if (value > 0xffffffff)
+                        break;
+                    return static_cast<std::uint32_t>(value);
+                }
+            }
+            throw BytecodeError("Number out of range");
+        }
+
+        std::uint32_t index()
+        {
+            std::uint32_t value = varint();
+            return value == 0 ? NoIndex : value - 1;
+        }
+
+        // a table size, when each entry takes at least the given number of bytes
+        std::uint32_t count(std::size_t entrySize)
+        {
+            std::uint32_t value = varint();
+            if ((m_size - m_pos) / entrySize < value)
+                throw BytecodeError("Truncated bytecode");
+            return value;
+        }
+
+        std::uint32_t u32()
+        {
+            need(4);
+            std::uint32_t value = 0;
+            for (std::size_t i = 0; i < 4; ++i)
+                value |= static_cast<std::uint32_t>(m_data[m_pos + i]) << (8 * i);
+            m_pos += 4;
+            return value;
+        }
+
+        std::uint64_t u64()
+        {
+            need(8);
+            std::uint64_t value = 0;
+            for (std::size_t i = 0; i < 8; ++i)
+                value |= static_cast<std::uint64_t>(m_data[m_pos + i]) << (8 * i);
+            m_pos += 8;
+            return value;
+        }
+
+        // a null-terminated string, left in the data
+        std::string_view string()
+        {
+            const void* end = std::memchr(m_data + m_pos, 0, m_size - m_pos);
+            if (end == nullptr)
+                throw BytecodeError("Unterminated symbol");
+
+            std::size_t length = static_cast<const std::uint8_t*>(end) - (m_data + m_pos);
+            std::string_view s(reinterpret_cast<const char*>(m_data + m_pos), length);
+            m_pos += length + 1;
+            return s;
+        }
+
+        const std::uint8_t* current() const
+        {
+            return m_data + m_pos;
+        }
+
+        bool atEnd() const
+        {
+            return m_pos == m_size;
+        }
+
+    private:
+        const std::uint8_t* m_data;
+        std::size_t m_size;
+        std::size_t m_pos;
+
+        void need(std::size_t bytes)
+        {
+            if (m_size - m_pos < bytes)
+                throw BytecodeError("Truncated bytecode");
+        }
+    };
+
+    void check(bool condition, const char* error)
+    {
+        if (!condition)
+            throw BytecodeError(error);
+    }
+
+    // the instruction at code, which was checked, returning its size
+    std::size_t decode(const std::uint8_t* code, Instruction& inst)
+    {
+        bool wide = code[0] == static_cast<std::uint8_t>(Op::Wide);
+        if (wide)
+            ++code;
+
+        inst.op = static_cast<Op>(code[0]);
+        inst.args[0] = inst.args[1] = inst.args[2] = 0;
+        for (std::size_t i = 0; i < argumentCount(inst.op); ++i)
+            inst.args[i] = wide ? load32(code + 1 + 4 * i) : code[1 + i];
+        return instructionSize(inst.op, wide);
+    }
+
+    // check the arguments of an instruction against the tables and the registers of its segment
+    void checkInstruction(const BytecodeView& bytecode, const SegmentView& segment, const Instruction& inst)
+    {
+        auto reg = [&](std::uint32_t r) { check(r < segment.registers, "Register out of range"); };
+        auto symbol = [&](std::uint32_t s) { check(s < bytecode.symbols.size(), "Symbol out of range"); };
+        auto field = [&](std::uint32_t i) {
+            check(segment.cls != NoIndex && i < bytecode.classes[segment.cls].attributes.size(), "Attribute out of range");
+        };
+        const std::uint32_t* a = inst.args;
+
+        switch (inst.op)
+        {
+            case Op::LoadConst:
+                reg(a[0]);
+                check(a[1] < bytecode.constants.size(), "Constant out of range");
+                break;
+
+            case Op::LoadGlobal:  reg(a[0]); symbol(a[1]); break;
+            case Op::StoreGlobal: symbol(a[0]); reg(a[1]); break;
+            case Op::GetField:    reg(a[0]); reg(a[1]); field(a[2]); break;
+            case Op::SetField:    reg(a[0]); field(a[1]); reg(a[2]); break;
+
+            case Op::Jump:
+                break;
+
+            case Op::JumpIfFalse:
+            case Op::JumpIfTrue:
+            case Op::Return:
+                reg(a[0]);
+                break;
+
+            // the arguments follow the register of the result
+            case Op::Call:
+                symbol(a[1]);
+                check(a[0] + std::max<std::size_t>(a[2], 1) <= segment.registers, "Register out of range");
+                break;
+
+            case Op::CallMethod:
+            case Op::New:
+                symbol(a[1]);
+                check(a[0] + static_cast<std::size_t>(a[2]) + 1 <= segment.registers, "Register out of range");
+                break;
+
+            default:
+                for (std::size_t i = 0; i < argumentCount(inst.op); ++i)
+                    reg(a[i]);
+                break;
+        }
+    }
+
+    // the constant as written in the listing
+    void constantToString(const Bytecode& bytecode, const Constant& constant, std::ostream& os)
+    {
+        switch (static_cast<ConstantType>(constant.index()))
+        {
+            case ConstantType::Nil:    os << "nil"; break;
+            case ConstantType::Int:    os << std::get<std::int64_t>(constant); break;
+            case ConstantType::Float:  os << std::get<double>(constant); break;
+            case ConstantType::String: os << "\"" << bytecode.symbols[std::get<std::uint32_t>(constant)] << "\""; break;
+            case ConstantType::Bool:   os << (std::get<bool>(constant) ? "true" : "false"); break;
+        }
+    }
+}
+
+std::size_t kafe::internal::argumentCount(Op op)
+{
+    return Ops[static_cast<std::size_t>(op)].arguments;
+}
+
+const char* kafe::internal::opName(Op op)
+{
+    return Ops[static_cast<std::size_t>(op)].name;
+}
+
+std::vector<std::uint8_t> Bytecode::write() const
+{
+    Writer w;
+
+    // header, the hash is filled at the end
+    for (char c : { 'k', 'a', 'f', 'e' })
+        w.u8(static_cast<std::uint8_t>(c));
+    for (std::uint8_t v : version)
+        w.u8(v);
+    w.u8(0);
+    w.u32(timestamp);
+    for (std::size_t i = 0; i < 16; ++i)
+        w.u8(0);
+
+    w.count(constants.size(), "constants");
+    for (const Constant& constant : constants)
+    {
+        w.u8(static_cast<std::uint8_t>(constant.index()));
+        switch (static_cast<ConstantType>(constant.index()))
+        {
+            case ConstantType::Nil:
+                break;
+
+            case ConstantType::Int:
+                w.u64(static_cast<std::uint64_t>(std::get<std::int64_t>(constant)));
+                break;
+
+            case ConstantType::Float:
+            {
+                double value = std::get<double>(constant);
+                std::uint64_t bits;
+                std::memcpy(&bits, &value, sizeof(bits));
+                w.u64(bits);
+                break;
+            }
+
+            case ConstantType::String:
+                w.varint(std::get<std::uint32_t>(constant));
+                break;
+
+            case ConstantType::Bool:
+                w.u8(std::get<bool>(constant) ? 1 : 0);
+                break;
+        }
+    }
+
+    w.count(symbols.size(), "symbols");
+    for (const std::string& symbol : symbols)
+    {
+        if (symbol.find('\0') != std::string::npos)
+            throw BytecodeError("A symbol can not contain a null character");
+        for (char c : symbol)
+            w.u8(static_cast<std::uint8_t>(c));
+        w.u8(0);
+    }
+
+    w.count(classes.size(), "classes");
+    for (const ClassInfo& cls : classes)
+    {
+        w.count(cls.attributes.size(), "attributes");
+        w.varint(cls.name);
+        for (const Attribute& attribute : cls.attributes)
+        {
+            w.varint(attribute.name);
+            w.varint(attribute.value);
+        }
+    }
+
+    w.count(segments.size(), "code segments");
+    for (const Segment& segment : segments)
+    {
+        w.index(segment.name);
+        w.index(segment.cls);
+        w.varint(segment.arguments);
+        w.varint(segment.registers);
+        w.count(segment.code.size(), "instructions");
+
+        // an instruction is wide when one of its arguments doesn't fit on 1 byte
+        std::vector<bool> wide(segment.code.size(), false);
+        for (std::size_t i = 0; i < segment.code.size(); ++i)
+        {
+            const Instruction& inst = segment.code[i];
+            for (std::size_t a = 0; a < argumentCount(inst.op); ++a)
+                wide[i] = wide[i] || (a != targetArgument(inst.op) && inst.args[a] > 0xff);
+        }
+
+        // the offset of a jump target depends on the size of the code before it: the jumps
+        // start narrow, and the ones going too far become wide until none changes
+        std::vector<std::size_t> offsets(segment.code.size() + 1, 0);
+        bool changed = true;
+        while (changed)
+        {
+            for (std::size_t i = 0; i < segment.code.size(); ++i)
+                offsets[i + 1] = offsets[i] + instructionSize(segment.code[i].op, wide[i]);
+
+            changed = false;
+            for (std::size_t i = 0; i < segment.code.size(); ++i)
+            {
+                const Instruction& inst = segment.code[i];
+                std::size_t target = targetArgument(inst.op);
+                if (!wide[i] && target < argumentCount(inst.op) && offsets[inst.args[target]] > 0xff)
+                {
+                    wide[i] = true;
+                    changed = true;
+                }
+            }
+        }
+        if (offsets.back() > 0xffffffff)
+            throw BytecodeError("Code segment too big");
+
+        for (std::size_t i = 0; i < segment.code.size(); ++i)
+        {
+            const Instruction& inst = segment.code[i];
+            if (wide[i])
+                w.u8(static_cast<std::uint8_t>(Op::Wide));
+            w.u8(static_cast<std::uint8_t>(inst.op));
+
+            std::size_t target = targetArgument(inst.op);
+            for (std::size_t a = 0; a < argumentCount(inst.op); ++a)
+            {
+                std::uint32_t value = a == target ? static_cast<std::uint32_t>(offsets[inst.args[a]]) : inst.args[a];
+                if (wide[i])
+                    w.u32(value);
+                else
+                    w.u8(static_cast<std::uint8_t>(value));
+            }
+        }
+    }
+
+    std::vector<std::uint8_t>& data = w.data();
+    MD5Digest hash = md5(data.data() + HeaderSize, data.size() - HeaderSize);
+    std::copy(hash.begin(), hash.end(), data.begin() + HeaderSize - 16);
+    return std::move(data);
+}
+
+Bytecode Bytecode::read(const std::uint8_t* data, std::size_t size)
+{
+    BytecodeView view = BytecodeView::read(data, size);
+
+    Bytecode bytecode;
+    std::copy(std::begin(view.version), std::end(view.version), bytecode.version);
+    bytecode.timestamp = view.timestamp;
+    bytecode.constants = std::move(view.constants);
+    bytecode.symbols.assign(view.symbols.begin(), view.symbols.end());
+    bytecode.classes = std::move(view.classes);
+
+    bytecode.segments.resize(view.segments.size());
+    std::vector<std::size_t> offsets;
+    for (std::size_t i = 0; i < view.segments.size(); ++i)
+    {
+        const SegmentView& v = view.segments[i];
+        Segment& segment = bytecode.segments[i];
+        segment.name = v.name;
+        segment.cls = v.cls;
+        segment.arguments = v.arguments;
+        segment.registers = v.registers;
+
+        segment.code.resize(v.size);
+        offsets.clear();
+        std::size_t offset = 0;
+        for (Instruction& inst : segment.code)
+        {
+            offsets.push_back(offset);
+            offset += decode(v.code + offset, inst);
+        }
+
+        // the jump targets were checked, they are translated into instruction indices
+        for (Instruction& inst : segment.code)
+        {
+            std::size_t target = targetArgument(inst.op);
+            if (target < argumentCount(inst.op))
+                inst.args[target] = static_cast<std::uint32_t>(
+                    std::lower_bound(offsets.begin(), offsets.end(), inst.args[target]) - offsets.begin());
+        }
+    }
+
+    return bytecode;
+}
+
+BytecodeView BytecodeView::read(const std::uint8_t* data, std::size_t size)
+{
+    check(size >= Bytecode::HeaderSize && std::memcmp(data, "kafe", 4) == 0, "Not a Kafe bytecode file");
+
+    BytecodeView bytecode;
+    Reader r(data, size);
+    r.u32();
+    for (std::uint8_t& v : bytecode.version)
+        v = r.u8();
+    check(bytecode.version[0] == KAFE_VERSION_MAJOR && bytecode.version[1] == KAFE_VERSION_MINOR,
+          "Bytecode compiled for another version of the VM");
+    r.u8();
+    bytecode.timestamp = r.u32();
+
+    MD5Digest hash = md5(data + Bytecode::HeaderSize, size - Bytecode::HeaderSize);
+    check(std::equal(hash.begin(), hash.end(), data + Bytecode::HeaderSize - 16), "Wrong bytecode hash");
+    for (std::size_t i = 0; i < 16; ++i)
+        r.u8();
+
+    bytecode.constants.resize(r.count(1));
+    for (Constant& constant : bytecode.constants)
+    {
+        switch (static_cast<ConstantType>(r.u8()))
+        {
+            case ConstantType::Nil:
+                break;
+
+            case ConstantType::Int:
+                constant = static_cast<std::int64_t>(r.u64());
+                break;
+
+            case ConstantType::Float:
+            {
+                std::uint64_t bits = r.u64();
+                double value;
+                std::memcpy(&value, &bits, sizeof(value));
+                constant = value;
+                break;
+            }
+
+            case ConstantType::String:
+                constant = r.varint();
+                break;
+
+            case ConstantType::Bool:
+                constant = r.u8() != 0;
+                break;
+
+            default:
+                throw BytecodeError("Unknown constant type");
+        }
+    }
+
+    bytecode.symbols.resize(r.count(1));
+    for (std::string_view& symbol : bytecode.symbols)
+        symbol = r.string();
+
+    for (const Constant& constant : bytecode.constants)
+    {
+        if (auto s = std::get_if<std::uint32_t>(&constant))
+            check(*s < bytecode.symbols.size(), "Symbol out of range");
+    }
+
+    bytecode.classes.resize(r.count(2));
+    for (ClassInfo& cls : bytecode.classes)
+    {
+        cls.attributes.resize(r.count(2));
+        cls.name = r.varint();
+        check(cls.name < bytecode.symbols.size(), "Symbol out of range");
+
+        for (Attribute& attribute : cls.attributes)
+        {
+            attribute.name = r.varint();
+            attribute.value = r.varint();
+            check(attribute.name < bytecode.symbols.size(), "Symbol out of range");
+            check(attribute.value < bytecode.constants.size(), "Constant out of range");
+        }
+    }
+
+    // a segment has a header of 5 bytes and at least one instruction
+    bytecode.segments.resize(r.count(7));
+    check(!bytecode.segments.empty(), "No code segment");
+    // byte offset of each instruction of a segment, kept between them to avoid allocating
+    std::vector<std::size_t> offsets;
+    for (SegmentView& segment : bytecode.segments)
+    {
+        segment.name = r.index();
+        segment.cls = r.index();
+        segment.arguments = r.varint();
+        segment.registers = r.varint();
+        check(segment.name == NoIndex || segment.name < bytecode.symbols.size(), "Symbol out of range");
+        check(segment.cls == NoIndex || segment.cls < bytecode.classes.size(), "Class out of range");
+        check(segment.arguments + (segment.cls != NoIndex ? 1u : 0u) <= segment.registers, "Too many arguments");
+
+        segment.size = r.count(2);
+        segment.code = r.current();
+        offsets.clear();
+        Instruction inst { Op::Return, { 0, 0, 0 } };
+        for (std::size_t i = 0; i < segment.size; ++i)
+        {
+            offsets.push_back(static_cast<std::size_t>(r.current() - segment.code));
+            std::uint8_t op = r.u8();
+            bool wide = op == static_cast<std::uint8_t>(Op::Wide);
+            if (wide)
+                op = r.u8();
+            check(op < static_cast<std::uint8_t>(Op::Wide), "Unknown op code");
+
+            inst.op = static_cast<Op>(op);
+            inst.args[0] = inst.args[1] = inst.args[2] = 0;
+            for (std::size_t a = 0; a < argumentCount(inst.op); ++a)
+                inst.args[a] = wide ? r.u32() : r.u8();
+
+            checkInstruction(bytecode, segment, inst);
+        }
+
+        // the VM doesn't check where it is, the code can't run past its end
+        check(segment.size > 0 && (inst.op == Op::Return || inst.op == Op::Jump), "Code segment not ending with a return");
+
+        // the jumps must go to the beginning of an instruction
+        for (std::size_t offset : offsets)
+        {
+            decode(segment.code + offset, inst);
+            std::size_t target = targetArgument(inst.op);
+            if (target < argumentCount(inst.op))
+                check(std::binary_search(offsets.begin(), offsets.end(), inst.args[target]), "Jump out of the code");
+        }
+    }
+
+    check(r.atEnd(), "Unexpected data after the code segments");
+    return bytecode;
+}
+
+void Bytecode::toString(std::ostream& os) const
+{
+    os << "(Constants\n";
+    for (std::size_t i = 0; i < constants.size(); ++i)
+    {
+        os << "    " << i << " ";
+        constantToString(*this, constants[i], os);
+        os << "\n";
+    }
+    os << ")\n(Symbols\n";
+    for (std::size_t i = 0; i < symbols.size(); ++i)
+        os << "    " << i << " " << symbols[i] << "\n";
+    os << ")\n";
+
+    for (const ClassInfo& cls : classes)
+    {
+        os << "(Class " << symbols[cls.name] << "\n";
+        for (const Attribute& attribute : cls.attributes)
+        {
+            os << "    " << symbols[attribute.name] << " = ";
+            constantToString(*this, constants[attribute.value], os);
+            os << "\n";
+        }
+        os << ")\n";
+    }
+
+    for (const Segment& segment : segments)
+    {
+        os << "(Segment ";
+        if (segment.cls != NoIndex)
+            os << symbols[classes[segment.cls].name] << ".";
+        os << (segment.name != NoIndex ? symbols[segment.name] : "<top level>")
+           << " (Args " << segment.arguments << ") (Registers " << segment.registers << ")\n";
+
+        for (std::size_t i = 0; i < segment.code.size(); ++i)
+        {
+            const Instruction& inst = segment.code[i];
+            os << "    " << i << " " << opName(inst.op);
+            for (std::size_t a = 0; a < argumentCount(inst.op); ++a)
+                os << " " << inst.args[a];
+            os << "\n";
+        }
+        os << ")\n";
+    }
+}
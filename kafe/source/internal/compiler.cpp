@@ -0,0 +1,691 @@
+#include <kafe/internal/compiler.hpp>
+
+#include <algorithm>
+#include <cstring>
+#include <ctime>
+#include <type_traits>
+
+using namespace kafe::internal;
+
+namespace
+{
+    // instruction of a binary operator, Op::Count if it isn't one
+    Op binaryOp(std::string_view op)
+    {
+        if (op == "+")  return Op::Add;
+        if (op == "-")  return Op::Sub;
+        if (op == "*")  return Op::Mul;
+        if (op == "/")  return Op::Div;
+        if (op == "<<") return Op::Shl;
+        if (op == ">>") return Op::Shr;
+        if (op == "==") return Op::Eq;
+        if (op == "!=") return Op::Ne;
+        if (op == "<")  return Op::Lt;
+        if (op == "<=") return Op::Le;
+        if (op == ">")  return Op::Gt;
+        if (op == ">=") return Op::Ge;
+        return Op::Count;
+    }
+
+    Op unaryOp(std::string_view op)
+    {
+        if (op == "-")   return Op::Neg;
+        if (op == "~")   return Op::BitNot;
+        if (op == "not") return Op::Not;
+        return Op::Count;
+    }
+
+    // instruction of an assignment operator (+=, -=...), Op::Move for =
+    Op assignmentOp(std::string_view op)
+    {
+        if (op == "=")
+            return Op::Move;
+        return binaryOp(op.substr(0, op.size() - 1));
+    }
+
+    // an attribute in the body of a class
+    struct AttributeDef
+    {
+        Symbol name;
+        Symbol type;
+        bool hasValue;
+        NodeRef value;
+    };
+
+    // false if the node isn't a Declaration, a Definition or a ConstDef
+    bool attributeDef(const Program& program, NodeRef ref, AttributeDef* def)
+    {
+        return visit(program.get(ref), [&](auto& node) {
+            using T = std::decay_t<decltype(node)>;
+
+            if constexpr (std::is_same_v<T, Declaration>)
+                *def = AttributeDef { node.varname, node.type, false, 0 };
+            else if constexpr (std::is_same_v<T, Definition> || std::is_same_v<T, ConstDef>)
+                *def = AttributeDef { node.varname, node.type, true, node.value };
+            else
+                return false;
+            return true;
+        });
+    }
+
+    // the last instruction of a body is a ret, nothing is needed after it
+    bool endsWithRet(const Program& program, NodeList body)
+    {
+        NodeSlice slice = program.slice(body);
+        return body.count > 0 && program.get(*(slice.end() - 1)).kind == NodeKind::Ret;
+    }
+
+    // the type of a constant and its bits, a double compared with == would merge -0.0 and 0.0
+    std::pair<std::size_t, std::uint64_t> constantKey(const Constant& value)
+    {
+        std::uint64_t bits = 0;
+        std::visit([&bits](const auto& v) {
+            using T = std::decay_t<decltype(v)>;
+
+            if constexpr (std::is_same_v<T, double>)
+                std::memcpy(&bits, &v, sizeof(bits));
+            else if constexpr (!std::is_same_v<T, std::monostate>)
+                bits = static_cast<std::uint64_t>(v);
+        }, value);
+        return { value.index(), bits };
+    }
+}
+
+Compiler::Compiler(const Program& program) :
+    m_program(program), m_segment(nullptr), m_class(nullptr), m_topLevel(true),
+    m_localCount(0), m_top(0), m_node(0)
+{}
+
+Bytecode Compiler::compile()
+{
+    m_bytecode.timestamp = static_cast<std::uint32_t>(std::time(nullptr));
+
+    // the classes and the constants can be used before being defined
+    for (NodeRef child : m_program.children)
+    {
+        m_node = child;
+        Node& node = m_program.get(child);
+        if (node.kind == NodeKind::Class)
+            declareClass(child);
+        else if (node.kind == NodeKind::ConstDef)
+            m_globalConstants.insert(m_program.get<ConstDef>(child).varname);
+    }
+
+    beginSegment(NoIndex, nullptr, NodeList());
+    for (NodeRef child : m_program.children)
+    {
+        NodeKind kind = m_program.get(child).kind;
+        if (kind != NodeKind::Function && kind != NodeKind::Class)
+            instruction(child);
+    }
+    endSegment(false);
+
+    std::unordered_set<Symbol> functions;
+    for (NodeRef child : m_program.children)
+    {
+        m_node = child;
+        Node& node = m_program.get(child);
+        if (node.kind == NodeKind::Function)
+        {
+            Symbol name = static_cast<Function&>(node).name;
+            if (!functions.insert(name).second)
+                error("Redefinition of the function '" + std::string(m_program.symbols.name(name)) + "'");
+            compileFunction(child, nullptr);
+        }
+        else if (node.kind == NodeKind::Class)
+            compileClass(child);
+    }
+
+    return std::move(m_bytecode);
+}
+
+void Compiler::error(const std::string& what)
+{
+    throw CompileError(what, m_program.get(m_node).span);
+}
+
+std::uint32_t Compiler::symbol(Symbol name)
+{
+    if (m_symbols.size() <= name)
+        m_symbols.resize(m_program.symbols.size(), 0);
+
+    if (m_symbols[name] == 0)
+        m_symbols[name] = symbol(m_program.symbols.name(name)) + 1u;
+    return static_cast<std::uint32_t>(m_symbols[name] - 1);
+}
+
+std::uint32_t Compiler::symbol(std::string_view text)
+{
+    auto it = m_symbolIndices.find(text);
+    if (it != m_symbolIndices.end())
+        return it->second;
+
+    if (m_bytecode.symbols.size() >= NoIndex)
+        error("Too many symbols");
+
+    std::uint32_t index = static_cast<std::uint32_t>(m_bytecode.symbols.size());
+    m_bytecode.symbols.emplace_back(text);
+    m_symbolIndices.emplace(text, index);
+    return index;
+}
+
+std::uint32_t Compiler::constant(const Constant& value)
+{
+    auto key = constantKey(value);
+    auto it = m_constants.find(key);
+    if (it != m_constants.end())
+        return it->second;
+
+    if (m_bytecode.constants.size() >= NoIndex)
+        error("Too many constants");
+
+    std::uint32_t index = static_cast<std::uint32_t>(m_bytecode.constants.size());
+    m_bytecode.constants.push_back(value);
+    m_constants.emplace(key, index);
+    return index;
+}
+
+std::uint32_t Compiler::defaultValue(Symbol type)
+{
+    std::string_view name = m_program.symbols.name(type);
+
+    if (name == "int")
+        return constant(std::int64_t(0));
+    if (name == "float")
+        return constant(0.0);
+    if (name == "bool")
+        return constant(false);
+    if (name == "string")
+        return constant(symbol(std::string_view()));
+    // instances
+    return constant(std::monostate());
+}
+
+bool Compiler::literal(NodeRef node, std::uint32_t* index)
+{
+    return visit(m_program.get(node), [&](auto& n) {
+        using T = std::decay_t<decltype(n)>;
+
+        if constexpr (std::is_same_v<T, Integer>)
+            *index = constant(n.value);
+        else if constexpr (std::is_same_v<T, Float>)
+            *index = constant(static_cast<double>(n.value));
+        else if constexpr (std::is_same_v<T, String>)
+            *index = constant(symbol(n.value));
+        else if constexpr (std::is_same_v<T, Bool>)
+            *index = constant(n.value);
+        else
+            return false;
+        return true;
+    });
+}
+
+std::size_t Compiler::emit(Op op, std::uint32_t a, std::uint32_t b, std::uint32_t c)
+{
+    if (m_segment->code.size() >= NoIndex)
+        error("Too many instructions in a function");
+
+    m_segment->code.push_back(Instruction { op, { a, b, c } });
+    return m_segment->code.size() - 1;
+}
+
+void Compiler::patch(std::size_t jump)
+{
+    Instruction& inst = m_segment->code[jump];
+    inst.args[inst.op == Op::Jump ? 0 : 1] = static_cast<std::uint32_t>(m_segment->code.size());
+}
+
+std::uint32_t Compiler::allocate()
+{
+    if (m_top == NoIndex)
+        error("Too many registers needed by a function");
+
+    std::uint32_t reg = m_top++;
+    m_segment->registers = std::max(m_segment->registers, m_top);
+    return reg;
+}
+
+void Compiler::declareClass(NodeRef ref)
+{
+    Class& cls = m_program.get<Class>(ref);
+    if (m_classes.count(cls.name) != 0)
+        error("Redefinition of the class '" + std::string(m_program.symbols.name(cls.name)) + "'");
+
+    ClassScope& scope = m_classes[cls.name];
+    scope.index = static_cast<std::uint32_t>(m_bytecode.classes.size());
+    m_bytecode.classes.push_back(ClassInfo { symbol(cls.name), {} });
+    ClassInfo& info = m_bytecode.classes.back();
+
+    for (NodeRef child : m_program.slice(cls.body))
+    {
+        m_node = child;
+
+        if (m_program.get(child).kind == NodeKind::Function)
+        {
+            Symbol method = m_program.get<Function>(child).name;
+            if (!scope.methods.insert(method).second)
+                error("Redefinition of the method '" + std::string(m_program.symbols.name(method)) + "'");
+            continue;
+        }
+
+        AttributeDef def;
+        if (!attributeDef(m_program, child, &def))
+            error("A class can only hold attributes and methods");
+
+        // the attributes whose value isn't a literal are set by the constructor
+        std::uint32_t value = 0;
+        if (!def.hasValue || !literal(def.value, &value))
+            value = defaultValue(def.type);
+
+        if (!scope.attributes.emplace(def.name, static_cast<std::uint32_t>(info.attributes.size())).second)
+            error("Redefinition of the attribute '" + std::string(m_program.symbols.name(def.name)) + "'");
+        info.attributes.push_back(Attribute { symbol(def.name), value });
+    }
+}
+
+void Compiler::beginSegment(std::uint32_t name, const ClassScope* cls, NodeList arguments)
+{
+    m_bytecode.segments.emplace_back();
+    m_segment = &m_bytecode.segments.back();
+    m_segment->name = name;
+    m_segment->cls = cls != nullptr ? cls->index : NoIndex;
+    m_segment->arguments = static_cast<std::uint32_t>(arguments.count);
+
+    m_class = cls;
+    m_topLevel = name == NoIndex;
+    m_locals.clear();
+    m_top = 0;
+
+    // the instance, then the arguments
+    if (cls != nullptr)
+        allocate();
+    for (NodeRef arg : m_program.slice(arguments))
+        m_locals[m_program.get<Declaration>(arg).varname] = Local { allocate(), false };
+    m_localCount = m_top;
+}
+
+void Compiler::endSegment(bool returns)
+{
+    if (!returns)
+    {
+        std::uint32_t reg = allocate();
+        emit(Op::LoadConst, reg, constant(std::monostate()));
+        emit(Op::Return, reg);
+    }
+}
+
+void Compiler::compileFunction(NodeRef ref, const ClassScope* cls)
+{
+    Function& function = m_program.get<Function>(ref);
+    m_node = ref;
+
+    beginSegment(symbol(function.name), cls, function.arguments);
+    block(function.body);
+    endSegment(endsWithRet(m_program, function.body));
+}
+
+void Compiler::compileClass(NodeRef ref)
+{
+    Class& cls = m_program.get<Class>(ref);
+    const ClassScope& scope = m_classes[cls.name];
+    ClsConstructor& constructor = m_program.get<ClsConstructor>(cls.constructor);
+
+    m_node = cls.constructor;
+    if (constructor.name != cls.name)
+        error("The constructor must have the name of its class");
+
+    beginSegment(symbol(cls.name), &scope, constructor.arguments);
+
+    // the attributes whose value isn't a literal
+    for (NodeRef child : m_program.slice(cls.body))
+    {
+        m_node = child;
+        AttributeDef def;
+        std::uint32_t value = 0;
+
+        if (attributeDef(m_program, child, &def) && def.hasValue && !literal(def.value, &value))
+        {
+            std::uint32_t top = m_top;
+            emit(Op::SetField, 0, scope.attributes.at(def.name), operand(def.value));
+            m_top = top;
+        }
+    }
+
+    block(constructor.body);
+    endSegment(endsWithRet(m_program, constructor.body));
+
+    for (NodeRef child : m_program.slice(cls.body))
+    {
+        if (m_program.get(child).kind == NodeKind::Function)
+            compileFunction(child, &scope);
+    }
+}
+
+void Compiler::block(NodeList body)
+{
+    // the variables of the block disappear after it, their registers can be reused
+    std::unordered_map<Symbol, Local> locals = m_locals;
+    std::uint32_t localCount = m_localCount;
+
+    for (NodeRef child : m_program.slice(body))
+        instruction(child);
+
+    m_locals = std::move(locals);
+    m_localCount = localCount;
+    m_top = localCount;
+}
+
+void Compiler::instruction(NodeRef ref)
+{
+    m_node = ref;
+    std::uint32_t top = m_top;
+
+    visit(m_program.get(ref), [&](auto& node) {
+        using T = std::decay_t<decltype(node)>;
+
+        if constexpr (std::is_same_v<T, Declaration>)
+        {
+            std::uint32_t reg = allocate();
+            emit(Op::LoadConst, reg, defaultValue(node.type));
+
+            if (m_topLevel)
+            {
+                emit(Op::StoreGlobal, symbol(node.varname), reg);
+                m_top = top;
+            }
+            else
+            {
+                m_locals[node.varname] = Local { reg, false };
+                m_localCount = m_top;
+            }
+        }
+        else if constexpr (std::is_same_v<T, Definition>)
+            define(node.varname, node.value, false);
+        else if constexpr (std::is_same_v<T, ConstDef>)
+            define(node.varname, node.value, true);
+        else if constexpr (std::is_same_v<T, Assignment>)
+            assign(node.varname, node.op, node.value);
+        else if constexpr (std::is_same_v<T, IfClause>)
+            ifClause(ref);
+        else if constexpr (std::is_same_v<T, WhileLoop>)
+        {
+            std::size_t start = m_segment->code.size();
+            std::size_t jump = emit(Op::JumpIfFalse, operand(node.condition));
+            m_top = top;
+
+            block(node.body);
+            emit(Op::Jump, static_cast<std::uint32_t>(start));
+            patch(jump);
+        }
+        else if constexpr (std::is_same_v<T, Ret>)
+        {
+            if (m_topLevel)
+                error("'ret' can only be used in a function");
+            emit(Op::Return, operand(node.value));
+            m_top = top;
+        }
+        else if constexpr (std::is_same_v<T, Function>)
+            error("Functions can only be defined at the top level");
+        else if constexpr (std::is_same_v<T, Class>)
+            error("Classes can only be defined at the top level");
+        else if constexpr (std::is_same_v<T, ClsConstructor>)
+            error("A constructor can only be defined in a class");
+        else if constexpr (std::is_same_v<T, End> || std::is_same_v<T, Elif> || std::is_same_v<T, Else>)
+        {
+            // left by the recover mode after a broken block, there is nothing to run
+        }
+        else
+        {
+            // an expression whose value isn't used, a function call
+            expression(ref, allocate());
+            m_top = top;
+        }
+    });
+}
+
+void Compiler::define(Symbol name, NodeRef value, bool constant)
+{
+    if (m_topLevel)
+    {
+        std::uint32_t top = m_top;
+        emit(Op::StoreGlobal, symbol(name), operand(value));
+        m_top = top;
+        return;
+    }
+
+    // the value is computed in the first free register, which becomes the variable
+    std::uint32_t reg = allocate();
+    expression(value, reg);
+    m_locals[name] = Local { reg, constant };
+    m_localCount = m_top;
+}
+
+void Compiler::assign(Symbol name, Symbol op, NodeRef value)
+{
+    std::string_view text = m_program.symbols.name(name);
+    Op arith = assignmentOp(m_program.symbols.name(op));
+    if (arith == Op::Count)
+        error("Unknown assignment operator '" + std::string(m_program.symbols.name(op)) + "'");
+
+    std::uint32_t top = m_top;
+    auto local = m_locals.find(name);
+    std::uint32_t index = 0;
+
+    if (local != m_locals.end())
+    {
+        if (local->second.constant)
+            error("Can not assign to the constant '" + std::string(text) + "'");
+
+        std::uint32_t reg = local->second.reg;
+        if (arith == Op::Move)
+            expression(value, reg);
+        else
+            emit(arith, reg, reg, operand(value));
+    }
+    else if (attribute(name, &index))
+    {
+        if (arith == Op::Move)
+            emit(Op::SetField, 0, index, operand(value));
+        else
+        {
+            std::uint32_t reg = allocate();
+            emit(Op::GetField, reg, 0, index);
+            emit(arith, reg, reg, operand(value));
+            emit(Op::SetField, 0, index, reg);
+        }
+    }
+    else
+    {
+        if (m_globalConstants.count(name) != 0)
+            error("Can not assign to the constant '" + std::string(text) + "'");
+
+        std::uint32_t reg = operand(value);
+        if (arith != Op::Move)
+        {
+            std::uint32_t current = allocate();
+            emit(Op::LoadGlobal, current, symbol(name));
+            emit(arith, current, current, reg);
+            reg = current;
+        }
+        emit(Op::StoreGlobal, symbol(name), reg);
+    }
+
+    m_top = top;
+}
+
+void Compiler::ifClause(NodeRef ref)
+{
+    IfClause& clause = m_program.get<IfClause>(ref);
+    NodeSlice elifs = m_program.slice(clause.elifClause);
+    std::uint32_t top = m_top;
+
+    // jumps from the end of each branch to the end of the clause
+    std::vector<std::size_t> ends;
+
+    auto branch = [&](NodeRef condition, NodeList body, bool last) {
+        std::size_t next = emit(Op::JumpIfFalse, operand(condition));
+        m_top = top;
+
+        block(body);
+        if (!last)
+            ends.push_back(emit(Op::Jump));
+        patch(next);
+    };
+
+    bool hasElse = clause.elseClause.count > 0;
+    branch(clause.condition, clause.body, clause.elifClause.count == 0 && !hasElse);
+    for (const NodeRef* elif = elifs.begin(); elif != elifs.end(); ++elif)
+    {
+        m_node = *elif;
+        IfClause& elifClause = m_program.get<IfClause>(*elif);
+        branch(elifClause.condition, elifClause.body, elif + 1 == elifs.end() && !hasElse);
+    }
+    block(clause.elseClause);
+
+    for (std::size_t jump : ends)
+        patch(jump);
+}
+
+void Compiler::expression(NodeRef ref, std::uint32_t target)
+{
+    m_node = ref;
+    // the temporary registers are freed at the end
+    std::uint32_t top = m_top;
+
+    visit(m_program.get(ref), [&](auto& node) {
+        using T = std::decay_t<decltype(node)>;
+
+        if constexpr (std::is_same_v<T, Integer> || std::is_same_v<T, Float> ||
+                      std::is_same_v<T, String> || std::is_same_v<T, Bool>)
+        {
+            std::uint32_t index = 0;
+            literal(ref, &index);
+            emit(Op::LoadConst, target, index);
+        }
+        else if constexpr (std::is_same_v<T, VarUse>)
+            loadVariable(node.name, target);
+        else if constexpr (std::is_same_v<T, BinaryOp>)
+        {
+            std::string_view op = m_program.symbols.name(node.op);
+
+            if (op == "and" || op == "or")
+            {
+                // the right hand side is only computed if needed. A variable given as
+                // target could be used by it, the result goes through a new register
+                std::uint32_t reg = target < m_localCount ? allocate() : target;
+                expression(node.lhs, reg);
+                std::size_t jump = emit(op == "and" ? Op::JumpIfFalse : Op::JumpIfTrue, reg);
+                expression(node.rhs, reg);
+                patch(jump);
+
+                if (reg != target)
+                    emit(Op::Move, target, reg);
+            }
+            else
+            {
+                Op inst = binaryOp(op);
+                if (inst == Op::Count)
+                    error("Unknown operator '" + std::string(op) + "'");
+
+                std::uint32_t lhs = operand(node.lhs);
+                std::uint32_t rhs = operand(node.rhs);
+                emit(inst, target, lhs, rhs);
+            }
+        }
+        else if constexpr (std::is_same_v<T, UnaryOp>)
+        {
+            Op inst = unaryOp(m_program.symbols.name(node.op));
+            if (inst == Op::Count)
+                error("Unknown operator '" + std::string(m_program.symbols.name(node.op)) + "'");
+
+            emit(inst, target, operand(node.operand));
+        }
+        else if constexpr (std::is_same_v<T, FunctionCall>)
+        {
+            // in a class, a method of the class is called on the instance
+            if (m_class != nullptr && m_class->methods.count(node.name) != 0)
+                call(Op::CallMethod, node.name, node.arguments, target, nullptr);
+            else
+                call(Op::Call, node.name, node.arguments, target, nullptr);
+        }
+        else if constexpr (std::is_same_v<T, MethodCall>)
+            call(Op::CallMethod, node.funcname, node.arguments, target, &node.classname);
+        else if constexpr (std::is_same_v<T, ClassInstanciation>)
+            call(Op::New, node.name, node.arguments, target, nullptr);
+        else
+            error("Expected an expression");
+    });
+
+    m_top = top;
+}
+
+std::uint32_t Compiler::operand(NodeRef ref)
+{
+    Node& node = m_program.get(ref);
+    if (node.kind == NodeKind::VarUse)
+    {
+        auto local = m_locals.find(static_cast<VarUse&>(node).name);
+        if (local != m_locals.end())
+            return local->second.reg;
+    }
+
+    std::uint32_t reg = allocate();
+    expression(ref, reg);
+    return reg;
+}
+
+void Compiler::call(Op op, Symbol name, NodeList arguments, std::uint32_t target, const Symbol* instance)
+{
+    // the arguments are put in consecutive registers, from the target if nothing is above it
+    std::uint32_t base = target + 1 == m_top && target >= m_localCount ? target : allocate();
+
+    if (op == Op::CallMethod)
+    {
+        if (instance != nullptr)
+            loadVariable(*instance, base);
+        else
+            emit(Op::Move, base, 0);
+    }
+
+    // a function gets its arguments from the register of the result, a method
+    // or a constructor after the instance (created by the VM for a constructor)
+    bool first = op == Op::Call;
+    for (NodeRef arg : m_program.slice(arguments))
+    {
+        expression(arg, first ? base : allocate());
+        first = false;
+    }
+
+    emit(op, base, symbol(name), static_cast<std::uint32_t>(arguments.count));
+    if (base != target)
+        emit(Op::Move, target, base);
+}
+
+void Compiler::loadVariable(Symbol name, std::uint32_t target)
+{
+    auto local = m_locals.find(name);
+    std::uint32_t index = 0;
+
+    if (local != m_locals.end())
+    {
+        if (local->second.reg != target)
+            emit(Op::Move, target, local->second.reg);
+    }
+    else if (attribute(name, &index))
+        emit(Op::GetField, target, 0, index);
+    else
+        emit(Op::LoadGlobal, target, symbol(name));
+}
+
+bool Compiler::attribute(Symbol name, std::uint32_t* index)
+{
+    if (m_class == nullptr)
+        return false;
+
+    auto it = m_class->attributes.find(name);
+    if (it == m_class->attributes.end())
+        return false;
+
+    *index = it->second;
+    return true;
+}
@@ -0,0 +1,79 @@
+#include <kafe/internal/interner.hpp>
+
+#include <cstring>
+
+using namespace kafe::internal;
+
+Interner::Interner() :
+    // names are short, small blocks are enough
+    m_arena(16 * 1024), m_slots(256, 0)
+{}
+
+Symbol Interner::intern(std::string_view name)
+{
+    std::uint32_t h = hash(name);
+    std::size_t mask = m_slots.size() - 1;
+
+    for (std::size_t i = h & mask; ; i = (i + 1) & mask)
+    {
+        std::uint32_t slot = m_slots[i];
+        if (slot == 0)
+        {
+            // not found, copy the name in the arena and take this slot
+            char* copy = static_cast<char*>(m_arena.allocate(name.size(), 1));
+            if (!name.empty())
+                std::memcpy(copy, name.data(), name.size());
+
+            Symbol symbol = static_cast<Symbol>(m_names.size());
+            m_names.emplace_back(copy, name.size());
+            m_hashes.push_back(h);
+            m_slots[i] = symbol + 1;
+
+            // keeping the table at most half full, for short probe sequences
+            if (m_names.size() * 2 > m_slots.size())
+                grow();
+            return symbol;
+        }
+
+        if (m_hashes[slot - 1] == h && m_names[slot - 1] == name)
+            return slot - 1;
+    }
+}
+
+std::string_view Interner::name(Symbol symbol) const
+{
+    return m_names[symbol];
+}
+
+std::size_t Interner::size() const
+{
+    return m_names.size();
+}
+
+std::uint32_t Interner::hash(std::string_view name)
+{
+    // FNV-1a, good enough for identifiers
+    std::uint32_t h = 2166136261u;
+    for (char c : name)
+    {
+        h ^= static_cast<unsigned char>(c);
+        h *= 16777619u;
+    }
+    return h;
+}
+
+void Interner::grow()
+{
+    std::vector<std::uint32_t> slots(m_slots.size() * 2, 0);
+    std::size_t mask = slots.size() - 1;
+
+    for (Symbol symbol = 0; symbol < m_names.size(); ++symbol)
+    {
+        std::size_t i = m_hashes[symbol] & mask;
+        while (slots[i] != 0)
+            i = (i + 1) & mask;
+        slots[i] = symbol + 1;
+    }
+
+    m_slots = std::move(slots);
+}
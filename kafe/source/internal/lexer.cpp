@@ -0,0 +1,304 @@
+#include <kafe/internal/lexer.hpp>
+#include <kafe/internal/scan.hpp>
+
+using namespace kafe::internal;
+
+namespace
+{
+    struct Keyword
+    {
+        std::string_view name;
+        TokenType type;
+    };
+
+    const Keyword g_keywords[] = {
+        { "fun",   TokenType::Fun },
+        { "end",   TokenType::End },
+        { "cst",   TokenType::Cst },
+        { "cls",   TokenType::Cls },
+        { "new",   TokenType::New },
+        { "while", TokenType::While },
+        { "do",    TokenType::Do },
+        { "if",    TokenType::If },
+        { "elif",  TokenType::Elif },
+        { "else",  TokenType::Else },
+        { "then",  TokenType::Then },
+        { "true",  TokenType::True },
+        { "false", TokenType::False },
+        { "ret",   TokenType::Ret },
+        // word operators
+        { "and",   TokenType::Operator },
+        { "or",    TokenType::Operator },
+        { "not",   TokenType::Operator }
+    };
+
+    struct Symbol
+    {
+        std::string_view text;
+        TokenType type;
+    };
+
+    // two characters symbols must come first, so that we always take the longest match
+    const Symbol g_symbols[] = {
+        { "->", TokenType::Arrow },
+        { "==", TokenType::Operator },
+        { "!=", TokenType::Operator },
+        { "<=", TokenType::Operator },
+        { ">=", TokenType::Operator },
+        { "<<", TokenType::Operator },
+        { ">>", TokenType::Operator },
+        { "+=", TokenType::AssignOp },
+        { "-=", TokenType::AssignOp },
+        { "*=", TokenType::AssignOp },
+        { "/=", TokenType::AssignOp },
+        { "+",  TokenType::Operator },
+        { "-",  TokenType::Operator },
+        { "*",  TokenType::Operator },
+        { "/",  TokenType::Operator },
+        { "<",  TokenType::Operator },
+        { ">",  TokenType::Operator },
+        { "~",  TokenType::Operator },
+        { "=",  TokenType::Assign },
+        { ":",  TokenType::Colon },
+        { ",",  TokenType::Comma },
+        { ".",  TokenType::Dot },
+        { "(",  TokenType::LParen },
+        { ")",  TokenType::RParen }
+    };
+}
+
+Lexer::Lexer(std::string_view code) :
+    ParserCombinators(code)
+{}
+
+Lexer::~Lexer()
+{}
+
+TokenList Lexer::tokenize()
+{
+    m_tokens.clear();
+
+    while (true)
+    {
+        inlineSpace();
+        if (isEOF())
+            break;
+
+        if (comment() || endOfLine())
+            continue;
+
+        if (word() || numberLiteral() || stringLiteral() || symbol())
+            continue;
+
+        // the parser reports it if it ever reaches this token
+        std::size_t start = getCount() - 1;
+        accept(IsAny);
+        push(TokenType::Invalid, start);
+    }
+
+    // the last instruction may not be followed by a line end
+    push(TokenType::EndOfFile, getSize());
+    m_tokens.back().length = 0;
+
+    return std::move(m_tokens);
+}
+
+void Lexer::push(TokenType type, std::size_t start)
+{
+    // the current symbol isn't part of the token
+    std::size_t end = getCount() - 1;
+    m_tokens.push_back(Token {
+        type,
+        static_cast<std::uint32_t>(start),
+        static_cast<std::uint32_t>(end - start)
+    });
+}
+
+bool Lexer::previousIsOperand()
+{
+    if (m_tokens.empty())
+        return false;
+
+    switch (m_tokens.back().type)
+    {
+        case TokenType::Name:
+        case TokenType::Integer:
+        case TokenType::Float:
+        case TokenType::String:
+        case TokenType::RParen:
+        case TokenType::True:
+        case TokenType::False:
+            return true;
+
+        default:
+            return false;
+    }
+}
+
+bool Lexer::inlineSpace()
+{
+    // consume all the ' ' at once
+    return acceptRun(scan::inlineSpaces);
+}
+
+bool Lexer::endOfLine()
+{
+    std::size_t start = getCount() - 1;
+
+    if ((accept(IsChar('\r')) || true) && accept(IsChar('\n')))
+    {
+        // empty lines and comment lines are collapsed into a single token
+        if (m_tokens.empty() || m_tokens.back().type == TokenType::NewLine)
+            return true;
+
+        push(TokenType::NewLine, start);
+        return true;
+    }
+    return false;
+}
+
+bool Lexer::comment()
+{
+    auto checkpoint = save();
+
+    // inline comment starts with '//'
+    if (accept(IsChar('/')))
+    {
+        if (accept(IsChar('/')))
+        {
+            // skip everything up to the end of the line
+            acceptRun(scan::untilNewLine);
+            return true;
+        }
+        // it was a division
+        restore(checkpoint);
+    }
+    return false;
+}
+
+bool Lexer::word()
+{
+    std::size_t start = getCount() - 1;
+
+    if (!name())
+        return false;
+
+    std::string_view text(getInput().data() + start, getCount() - 1 - start);
+    for (const Keyword& keyword : g_keywords)
+    {
+        if (keyword.name == text)
+        {
+            push(keyword.type, start);
+            return true;
+        }
+    }
+
+    push(TokenType::Name, start);
+    return true;
+}
+
+bool Lexer::numberLiteral()
+{
+    std::size_t start = getCount() - 1;
+    auto checkpoint = save();
+
+    // a '-' directly followed by a digit is a negative number,
+    // unless we are in the middle of an operation (eg 4 -5)
+    if (!previousIsOperand())
+        accept(IsMinus);
+
+    // 0x1F and 0b1010 are always integers
+    if (prefixedDigits('x', IsHexDigit) || prefixedDigits('b', IsBinDigit))
+    {
+        push(TokenType::Integer, start);
+        return true;
+    }
+
+    if (!digits(IsDigit))
+    {
+        restore(checkpoint);
+        return false;
+    }
+
+    // looking for the decimal part, the kind of number is known in a single pass
+    checkpoint = save();
+    if (accept(IsChar('.')))
+    {
+        if (digits(IsDigit))
+        {
+            push(TokenType::Float, start);
+            return true;
+        }
+        restore(checkpoint);
+    }
+
+    push(TokenType::Integer, start);
+    return true;
+}
+
+bool Lexer::digits(const CharClass& digit)
+{
+    if (!accept(digit))
+        return false;
+
+    while (true)
+    {
+        if (accept(digit))
+            continue;
+
+        // a '_' can separate two digits (eg 1_000_000), but it can't end a number
+        auto checkpoint = save();
+        if (accept(IsChar('_')) && accept(digit))
+            continue;
+
+        restore(checkpoint);
+        return true;
+    }
+}
+
+bool Lexer::prefixedDigits(char letter, const CharClass& digit)
+{
+    auto checkpoint = save();
+    if (accept(IsChar('0')) && accept(IsChar(letter)) && digits(digit))
+        return true;
+
+    restore(checkpoint);
+    return false;
+}
+
+bool Lexer::stringLiteral()
+{
+    std::size_t start = getCount() - 1;
+
+    if (!accept(IsChar('"')))
+        return false;
+
+    acceptRun(scan::untilQuote);
+    // an unterminated string takes the rest of the file
+    if (!accept(IsChar('"')))
+    {
+        push(TokenType::Invalid, start);
+        return true;
+    }
+
+    push(TokenType::String, start);
+    return true;
+}
+
+bool Lexer::symbol()
+{
+    std::size_t start = getCount() - 1;
+    std::string_view rest(getInput().data() + start, getSize() - start);
+
+    for (const Symbol& sym : g_symbols)
+    {
+        if (rest.compare(0, sym.text.size(), sym.text) == 0)
+        {
+            for (std::size_t i=0; i < sym.text.size(); ++i)
+                accept(IsAny);
+            push(sym.type, start);
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,43 @@
+#include <kafe/internal/lineindex.hpp>
+#include <kafe/internal/scan.hpp>
+
+#include <algorithm>
+
+using namespace kafe::internal;
+
+LineIndex::LineIndex(std::string_view source) :
+    m_source(source), m_built(false)
+{}
+
+Position LineIndex::position(std::size_t offset)
+{
+    if (!m_built)
+        build();
+
+    // the last line starting at or before the offset
+    auto line = std::upper_bound(m_starts.begin(), m_starts.end(), offset) - 1;
+
+    return Position {
+        static_cast<int>(line - m_starts.begin()) + 1,
+        static_cast<int>(offset - *line) + 1
+    };
+}
+
+void LineIndex::build()
+{
+    const char* data = m_source.data();
+    std::size_t size = m_source.size();
+
+    m_starts.reserve(scan::countNewLines(data, size) + 1);
+    m_starts.push_back(0);
+
+    // jumping from one line end to the next one
+    std::size_t i = scan::untilNewLine(data, size);
+    while (i < size)
+    {
+        m_starts.push_back(i + 1);
+        i += 1 + scan::untilNewLine(data + i + 1, size - i - 1);
+    }
+
+    m_built = true;
+}
@@ -0,0 +1,149 @@
+#include <kafe/internal/mappedfile.hpp>
+
+#include <stdexcept>
+#include <utility>
+
+#ifdef _WIN32
+    #define WIN32_LEAN_AND_MEAN
+    #define NOMINMAX
+    #include <windows.h>
+#else
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <fcntl.h>
+    #include <unistd.h>
+#endif
+
+using namespace kafe::internal;
+
+#ifdef _WIN32
+
+MappedFile::MappedFile(const std::string& path) :
+    m_data(nullptr), m_size(0), m_mapping(nullptr)
+{
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+        throw std::runtime_error("Couldn't open file " + path);
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size))
+    {
+        CloseHandle(file);
+        throw std::runtime_error("Couldn't get the size of file " + path);
+    }
+    m_size = static_cast<std::size_t>(size.QuadPart);
+
+    // an empty file can't be mapped, but it's still a valid (empty) view
+    if (m_size > 0)
+    {
+        m_mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (m_mapping != nullptr)
+            m_data = static_cast<const char*>(MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0));
+    }
+    CloseHandle(file);
+
+    if (m_size > 0 && m_data == nullptr)
+    {
+        unmap();
+        throw std::runtime_error("Couldn't map file " + path);
+    }
+}
+
+void MappedFile::unmap()
+{
+    if (m_data != nullptr)
+        UnmapViewOfFile(m_data);
+    if (m_mapping != nullptr)
+        CloseHandle(m_mapping);
+
+    m_data = nullptr;
+    m_mapping = nullptr;
+    m_size = 0;
+}
+
+MappedFile::MappedFile(MappedFile&& other) noexcept :
+    m_data(std::exchange(other.m_data, nullptr)),
+    m_size(std::exchange(other.m_size, 0)),
+    m_mapping(std::exchange(other.m_mapping, nullptr))
+{}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept
+{
+    if (this != &other)
+    {
+        unmap();
+        m_data = std::exchange(other.m_data, nullptr);
+        m_size = std::exchange(other.m_size, 0);
+        m_mapping = std::exchange(other.m_mapping, nullptr);
+    }
+    return *this;
+}
+
+#else
+
+MappedFile::MappedFile(const std::string& path) :
+    m_data(nullptr), m_size(0)
+{
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd == -1)
+        throw std::runtime_error("Couldn't open file " + path);
+
+    struct stat infos;
+    if (fstat(fd, &infos) == -1)
+    {
+        close(fd);
+        throw std::runtime_error("Couldn't get the size of file " + path);
+    }
+    m_size = static_cast<std::size_t>(infos.st_size);
+
+    // an empty file can't be mapped, but it's still a valid (empty) view
+    if (m_size > 0)
+    {
+        void* data = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED)
+        {
+            close(fd);
+            throw std::runtime_error("Couldn't map file " + path);
+        }
+        m_data = static_cast<const char*>(data);
+    }
+    // the mapping stays valid after closing the file
+    close(fd);
+}
+
+void MappedFile::unmap()
+{
+    if (m_data != nullptr)
+        munmap(const_cast<char*>(m_data), m_size);
+
+    m_data = nullptr;
+    m_size = 0;
+}
+
+MappedFile::MappedFile(MappedFile&& other) noexcept :
+    m_data(std::exchange(other.m_data, nullptr)),
+    m_size(std::exchange(other.m_size, 0))
+{}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept
+{
+    if (this != &other)
+    {
+        unmap();
+        m_data = std::exchange(other.m_data, nullptr);
+        m_size = std::exchange(other.m_size, 0);
+    }
+    return *this;
+}
+
+#endif
+
+MappedFile::~MappedFile()
+{
+    unmap();
+}
+
+std::string_view MappedFile::view() const
+{
+    return std::string_view(m_data, m_size);
+}
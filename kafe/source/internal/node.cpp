@@ -1,5 +1,7 @@
 #include <kafe/internal/node.hpp>
 
+#include <algorithm>
+
 using namespace kafe::internal;
 
 inline void printIndent(std::ostream& os, std::size_t i)
@@ -8,123 +10,266 @@ inline void printIndent(std::ostream& os, std::size_t i)
         os << "    ";
 }
 
+// (Name child... ) on its own lines, (Name) when the list is empty
+inline void printList(const Program& program, std::ostream& os, const char* name, NodeList list, std::size_t indent)
+{
+    printIndent(os, indent);     os << "(" << name;
+    for (NodeRef node: program.slice(list))
+    {
+        os << "\n";
+        program.toString(node, os, indent + 1);
+    }
+    if (list.count > 0)
+    {
+        os << "\n";
+        printIndent(os, indent);
+    }
+    os << ")";
+}
+
 // ---------------------------
 
-Node::Node(const std::string& nodename) :
-    nodename(nodename)
+Span::Span() :
+    offset(0), length(0), file(0)
+{}
+
+Span::Span(std::uint32_t file, std::uint32_t offset, std::uint32_t length) :
+    offset(offset), length(std::min(length, MaxLength)), file(file)
+{}
+
+Node::Node(NodeKind kind) :
+    kind(kind)
 {}
 
 // ---------------------------
 
-Program::Program() :
-    Node("program")
+Program::Program()
 {}
 
+NodeList Program::list(const std::vector<NodeRef>& refs)
+{
+    NodeList list { static_cast<std::uint32_t>(m_lists.size()), static_cast<std::uint32_t>(refs.size()) };
+    m_lists.insert(m_lists.end(), refs.begin(), refs.end());
+    return list;
+}
+
+NodeSlice Program::slice(NodeList list) const
+{
+    const NodeRef* first = m_lists.data() + list.begin;
+    return NodeSlice { first, first + list.count };
+}
+
+void Program::toString(NodeRef node, std::ostream& os, std::size_t indent) const
+{
+    visit(get(node), [&](auto& n) { n.toString(*this, os, indent); });
+}
+
+std::string_view Program::text(std::string_view s)
+{
+    char* data = static_cast<char*>(m_arena.allocate(s.size(), alignof(char)));
+    std::copy(s.begin(), s.end(), data);
+    return std::string_view(data, s.size());
+}
+
+std::size_t Program::size() const
+{
+    return m_nodes.size();
+}
+
+namespace
+{
+    // translate the references and symbols of nodes moved from another program
+    struct Remap
+    {
+        NodeRef nodes;         // index of the first moved node
+        std::uint32_t lists;   // index of the first moved reference in the child lists
+        const std::vector<Symbol>& symbols;  // by symbol in the other program
+
+        void ref(NodeRef& r) const { r += nodes; }
+        void list(NodeList& l) const { l.begin += lists; }
+        void sym(Symbol& s) const { s = symbols[s]; }
+
+        void operator()(Declaration& n) const        { sym(n.varname); sym(n.type); }
+        void operator()(Definition& n) const         { sym(n.varname); sym(n.type); ref(n.value); }
+        void operator()(ConstDef& n) const           { sym(n.varname); sym(n.type); ref(n.value); }
+        void operator()(Assignment& n) const         { sym(n.varname); sym(n.op); ref(n.value); }
+        void operator()(Function& n) const           { sym(n.name); sym(n.type); list(n.arguments); list(n.body); }
+        void operator()(Class& n) const              { sym(n.name); ref(n.constructor); list(n.body); }
+        void operator()(IfClause& n) const           { ref(n.condition); list(n.body); list(n.elifClause); list(n.elseClause); }
+        void operator()(WhileLoop& n) const          { ref(n.condition); list(n.body); }
+        void operator()(Integer&) const              {}
+        void operator()(Float&) const                {}
+        void operator()(String&) const               {}
+        void operator()(Bool&) const                 {}
+        void operator()(VarUse& n) const             { sym(n.name); }
+        void operator()(BinaryOp& n) const           { sym(n.op); ref(n.lhs); ref(n.rhs); }
+        void operator()(UnaryOp& n) const            { sym(n.op); ref(n.operand); }
+        void operator()(FunctionCall& n) const       { sym(n.name); list(n.arguments); }
+        void operator()(MethodCall& n) const         { sym(n.classname); sym(n.funcname); list(n.arguments); }
+        void operator()(ClassInstanciation& n) const { sym(n.name); list(n.arguments); }
+        void operator()(ClsConstructor& n) const     { sym(n.name); list(n.arguments); list(n.body); }
+        void operator()(End&) const                  {}
+        void operator()(Elif&) const                 {}
+        void operator()(Else&) const                 {}
+        void operator()(Ret& n) const                { ref(n.value); }
+    };
+}
+
+void Program::merge(Program&& other)
+{
+    other.relocate(static_cast<NodeRef>(m_nodes.size()), static_cast<std::uint32_t>(m_lists.size()), other.symbolsIn(symbols));
+    append(std::move(other));
+}
+
+std::vector<Symbol> Program::symbolsIn(Interner& other) const
+{
+    std::vector<Symbol> table(symbols.size());
+    for (Symbol s = 0; s < table.size(); ++s)
+        table[s] = other.intern(symbols.name(s));
+    return table;
+}
+
+void Program::relocate(NodeRef nodes, std::uint32_t lists, const std::vector<Symbol>& symbols)
+{
+    Remap remap { nodes, lists, symbols };
+    for (Node* node : m_nodes)
+        visit(*node, remap);
+
+    for (NodeRef& ref : m_lists)
+        ref += nodes;
+    for (NodeRef& ref : children)
+        ref += nodes;
+}
+
+void Program::append(Program&& other)
+{
+    // the nodes don't move, only the arena blocks holding them change hands
+    m_nodes.insert(m_nodes.end(), other.m_nodes.begin(), other.m_nodes.end());
+    m_lists.insert(m_lists.end(), other.m_lists.begin(), other.m_lists.end());
+    children.insert(children.end(), other.children.begin(), other.children.end());
+    m_arena.adopt(std::move(other.m_arena));
+
+    other.clear();
+}
+
+std::size_t Program::listsSize() const
+{
+    return m_lists.size();
+}
+
+void Program::clear()
+{
+    children.clear();
+    m_arena.clear();
+    m_nodes.clear();
+    m_lists.clear();
+}
+
 void Program::toString(std::ostream& os, std::size_t indent)
 {
     os << "(Program";
-    for (auto& node: children)
+    for (NodeRef node: children)
     {
         os << "\n";
-        node->toString(os, indent + 1);
+        toString(node, os, indent + 1);
     }
     os << "\n)";
 }
 
 // ---------------------------
 
-Declaration::Declaration(const std::string& varname, const std::string& type) :
+Declaration::Declaration(Symbol varname, Symbol type) :
     varname(varname), type(type)
-    , Node("decl")
+    , Node(NodeKind::Declaration)
 {}
 
-void Declaration::toString(std::ostream& os, std::size_t indent)
+void Declaration::toString(const Program& program, std::ostream& os, std::size_t indent) const
 {
     printIndent(os, indent);     os << "(Declaration\n";
-    printIndent(os, indent + 1);     os << "(VarName " << varname << ")\n";
-    printIndent(os, indent + 1);     os << "(Type " << type << ")\n";
+    printIndent(os, indent + 1);     os << "(VarName " << program.symbols.name(varname) << ")\n";
+    printIndent(os, indent + 1);     os << "(Type " << program.symbols.name(type) << ")\n";
     printIndent(os, indent);     os << ")";
 }
 
 // ---------------------------
 
-Definition::Definition(const std::string& varname, const std::string& type, NodePtr value) :
-    varname(varname), type(type), value(std::move(value))
-    , Node("def")
+Definition::Definition(Symbol varname, Symbol type, NodeRef value) :
+    varname(varname), type(type), value(value)
+    , Node(NodeKind::Definition)
 {}
 
-void Definition::toString(std::ostream& os, std::size_t indent)
+void Definition::toString(const Program& program, std::ostream& os, std::size_t indent) const
 {
     printIndent(os, indent);     os << "(Definition\n";
-    printIndent(os, indent + 1);     os << "(VarName " << varname << ")\n";
-    printIndent(os, indent + 1);     os << "(Type " << type << ")\n";
-                                     value->toString(os, indent + 1); os << "\n";
+    printIndent(os, indent + 1);     os << "(VarName " << program.symbols.name(varname) << ")\n";
+    printIndent(os, indent + 1);     os << "(Type " << program.symbols.name(type) << ")\n";
+                                     program.toString(value, os, indent + 1); os << "\n";
     printIndent(os, indent);     os << ")";
 }
 
 // ---------------------------
 
-ConstDef::ConstDef(const std::string& varname, const std::string& type, NodePtr value) :
-    varname(varname), type(type), value(std::move(value))
-    , Node("const def")
+ConstDef::ConstDef(Symbol varname, Symbol type, NodeRef value) :
+    varname(varname), type(type), value(value)
+    , Node(NodeKind::ConstDef)
 {}
 
-void ConstDef::toString(std::ostream& os, std::size_t indent)
+void ConstDef::toString(const Program& program, std::ostream& os, std::size_t indent) const
 {
     printIndent(os, indent);     os << "(ConstDef\n";
-    printIndent(os, indent + 1);     os << "(VarName " << varname << ")\n";
-    printIndent(os, indent + 1);     os << "(Type " << type << ")\n";
-                                     value->toString(os, indent + 1); os << "\n";
+    printIndent(os, indent + 1);     os << "(VarName " << program.symbols.name(varname) << ")\n";
+    printIndent(os, indent + 1);     os << "(Type " << program.symbols.name(type) << ")\n";
+                                     program.toString(value, os, indent + 1); os << "\n";
     printIndent(os, indent);     os << ")";
 }
 
 // ---------------------------
 
-Assignment::Assignment(const std::string& varname, NodePtr value, const std::string& op) :
-    varname(varname), value(std::move(value)), op(op)
-    , Node("assignment")
+Assignment::Assignment(Symbol varname, NodeRef value, Symbol op) :
+    varname(varname), value(value), op(op)
+    , Node(NodeKind::Assignment)
 {}
 
-void Assignment::toString(std::ostream& os, std::size_t indent)
+void Assignment::toString(const Program& program, std::ostream& os, std::size_t indent) const
 {
     printIndent(os, indent);     os << "(Assignment\n";
-    printIndent(os, indent + 1);     os << "(VarName " << varname << ")\n";
-    printIndent(os, indent + 1);     os << op << "\n";
-                                     value->toString(os, indent + 1); os << "\n";
+    printIndent(os, indent + 1);     os << "(VarName " << program.symbols.name(varname) << ")\n";
+    printIndent(os, indent + 1);     os << program.symbols.name(op) << "\n";
+                                     program.toString(value, os, indent + 1); os << "\n";
     printIndent(os, indent);     os << ")";
 }
 
 // ---------------------------
 
-Function::Function(const std::string& name, NodePtrList arguments, const std::string& type, NodePtrList body) :
-    name(name), arguments(std::move(arguments)), type(type), body(std::move(body))
-    , Node("function")
+Function::Function(Symbol name, NodeList arguments, Symbol type, NodeList body) :
+    name(name), arguments(arguments), type(type), body(body)
+    , Node(NodeKind::Function)
 {}
 
-void Function::toString(std::ostream& os, std::size_t indent)
+void Function::toString(const Program& program, std::ostream& os, std::size_t indent) const
 {
     printIndent(os, indent);     os << "(Function\n";
-    printIndent(os, indent + 1);     os << "(Name " << name << ")\n";
+    printIndent(os, indent + 1);     os << "(Name " << program.symbols.name(name) << ")\n";
     printIndent(os, indent + 1);     os << "(Args";
-    for (auto& node: arguments)
+    for (NodeRef node: program.slice(arguments))
     {
         os << "\n";
-        node->toString(os, indent + 2);
+        program.toString(node, os, indent + 2);
     }
-    if (arguments.size() > 0)
+    if (arguments.count > 0)
     {
         os << "\n";
         printIndent(os, indent + 1);
     }
     os << ")\n";
-    printIndent(os, indent + 1);     os << "(Type " << type << ")\n";
+    printIndent(os, indent + 1);     os << "(Type " << program.symbols.name(type) << ")\n";
     printIndent(os, indent + 1);     os << "(Body";
-    for (auto& node: body)
+    for (NodeRef node: program.slice(body))
     {
         os << "\n";
-        node->toString(os, indent + 2);
+        program.toString(node, os, indent + 2);
     }
-    if (body.size() > 0)
+    if (body.count > 0)
     {
         os << "\n";
         printIndent(os, indent + 1);
@@ -135,23 +280,23 @@ void Function::toString(std::ostream& os, std::size_t indent)
 
 // ---------------------------
 
-Class::Class(const std::string& name, NodePtr constructor, NodePtrList body) :
-    name(name), constructor(std::move(constructor)), body(std::move(body))
-    , Node("class")
+Class::Class(Symbol name, NodeRef constructor, NodeList body) :
+    name(name), constructor(constructor), body(body)
+    , Node(NodeKind::Class)
 {}
 
-void Class::toString(std::ostream& os, std::size_t indent)
+void Class::toString(const Program& program, std::ostream& os, std::size_t indent) const
 {
     printIndent(os, indent);     os << "(Class\n";
-    printIndent(os, indent + 1);     os << "(Name " << name << ")\n";
-    constructor->toString(os, indent + 1); os << "\n";
+    printIndent(os, indent + 1);     os << "(Name " << program.symbols.name(name) << ")\n";
+    program.toString(constructor, os, indent + 1); os << "\n";
     printIndent(os, indent + 1);     os << "(Body";
-    for (auto& node: body)
+    for (NodeRef node: program.slice(body))
     {
         os << "\n";
-        node->toString(os, indent + 2);
+        program.toString(node, os, indent + 2);
     }
-    if (body.size() > 0)
+    if (body.count > 0)
     {
         os << "\n";
         printIndent(os, indent + 1);
@@ -162,36 +307,44 @@ void Class::toString(std::ostream& os, std::size_t indent)
 
 // ---------------------------
 
-IfClause::IfClause(NodePtr condition, NodePtrList body, NodePtrList elifClause, NodePtrList elseClause) :
-    condition(std::move(condition)), body(std::move(body)), elifClause(std::move(elifClause)), elseClause(std::move(elseClause))
-    , Node("if")
+IfClause::IfClause(NodeRef condition, NodeList body, NodeList elifClause, NodeList elseClause) :
+    condition(condition), body(body), elifClause(elifClause), elseClause(elseClause)
+    , Node(NodeKind::IfClause)
 {}
 
-void IfClause::toString(std::ostream& os, std::size_t indent)
+void IfClause::toString(const Program& program, std::ostream& os, std::size_t indent) const
 {
-    printIndent(os, indent);     os << "(IfClause)";
+    printIndent(os, indent);     os << "(IfClause\n";
+                                 program.toString(condition, os, indent + 1); os << "\n";
+    printList(program, os, "Body", body, indent + 1); os << "\n";
+    printList(program, os, "Elif", elifClause, indent + 1); os << "\n";
+    printList(program, os, "Else", elseClause, indent + 1); os << "\n";
+    printIndent(os, indent);     os << ")";
 }
 
 // ---------------------------
 
-WhileLoop::WhileLoop(NodePtr condition, NodePtrList body) :
-    condition(std::move(condition)), body(std::move(body))
-    , Node("while")
+WhileLoop::WhileLoop(NodeRef condition, NodeList body) :
+    condition(condition), body(body)
+    , Node(NodeKind::WhileLoop)
 {}
 
-void WhileLoop::toString(std::ostream& os, std::size_t indent)
+void WhileLoop::toString(const Program& program, std::ostream& os, std::size_t indent) const
 {
-    printIndent(os, indent);     os << "(WhileLoop)";
+    printIndent(os, indent);     os << "(WhileLoop\n";
+                                 program.toString(condition, os, indent + 1); os << "\n";
+    printList(program, os, "Body", body, indent + 1); os << "\n";
+    printIndent(os, indent);     os << ")";
 }
 
 // ---------------------------
 
-Integer::Integer(int n) :
+Integer::Integer(std::int64_t n) :
     value(n)
-    , Node("integer")
+    , Node(NodeKind::Integer)
 {}
 
-void Integer::toString(std::ostream& os, std::size_t indent)
+void Integer::toString(const Program&, std::ostream& os, std::size_t indent) const
 {
     printIndent(os, indent);     os << "(Integer " << value << ")";
 }
@@ -200,22 +353,22 @@ void Integer::toString(std::ostream& os, std::size_t indent)
 
 Float::Float(float f) :
     value(f)
-    , Node("float")
+    , Node(NodeKind::Float)
 {}
 
-void Float::toString(std::ostream& os, std::size_t indent)
+void Float::toString(const Program&, std::ostream& os, std::size_t indent) const
 {
     printIndent(os, indent);     os << "(Float " << value << ")";
 }
 
 // ---------------------------
 
-String::String(const std::string& s) :
+String::String(std::string_view s) :
     value(s)
-    , Node("string")
+    , Node(NodeKind::String)
 {}
 
-void String::toString(std::ostream& os, std::size_t indent)
+void String::toString(const Program&, std::ostream& os, std::size_t indent) const
 {
     printIndent(os, indent);     os << "(String \"" << value << "\")";
 }
@@ -224,76 +377,74 @@ void String::toString(std::ostream& os, std::size_t indent)
 
 Bool::Bool(bool b) :
     value(b)
-    , Node("bool")
+    , Node(NodeKind::Bool)
 {}
 
-void Bool::toString(std::ostream& os, std::size_t indent)
+void Bool::toString(const Program&, std::ostream& os, std::size_t indent) const
 {
     printIndent(os, indent);     os << "(Bool " << (value ? "true" : "false") << ")";
 }
 
 // ---------------------------
 
-VarUse::VarUse(const std::string& name) :
+VarUse::VarUse(Symbol name) :
     name(name)
-    , Node("var use")
+    , Node(NodeKind::VarUse)
 {}
 
-void VarUse::toString(std::ostream& os, std::size_t indent)
+void VarUse::toString(const Program& program, std::ostream& os, std::size_t indent) const
 {
-    printIndent(os, indent);     os << "(VarUse " << name << ")";
+    printIndent(os, indent);     os << "(VarUse " << program.symbols.name(name) << ")";
 }
 
 // ---------------------------
 
-Operator::Operator(const std::string& name) :
-    name(name)
-    , Node("operator")
+BinaryOp::BinaryOp(Symbol op, NodeRef lhs, NodeRef rhs) :
+    op(op), lhs(lhs), rhs(rhs)
+    , Node(NodeKind::BinaryOp)
 {}
 
-void Operator::toString(std::ostream& os, std::size_t indent)
+void BinaryOp::toString(const Program& program, std::ostream& os, std::size_t indent) const
 {
-    printIndent(os, indent);     os << "(Operator " << name << ")";
+    printIndent(os, indent);     os << "(BinaryOp\n";
+    printIndent(os, indent + 1);     os << "(Operator " << program.symbols.name(op) << ")\n";
+                                     program.toString(lhs, os, indent + 1); os << "\n";
+                                     program.toString(rhs, os, indent + 1); os << "\n";
+    printIndent(os, indent);     os << ")";
 }
 
 // ---------------------------
-
-OperationsList::OperationsList(NodePtrList operations) :
-    operations(std::move(operations))
-    , Node("op list")
+UnaryOp::UnaryOp(Symbol op, NodeRef operand) :
+    op(op), operand(operand)
+    , Node(NodeKind::UnaryOp)
 {}
 
-void OperationsList::toString(std::ostream& os, std::size_t indent)
+void UnaryOp::toString(const Program& program, std::ostream& os, std::size_t indent) const
 {
-    printIndent(os, indent);     os << "(OperationsList";
-    for (auto& node: operations)
-    {
-        os << "\n";
-        node->toString(os, indent + 1);
-    }
-    if (operations.size() > 0)
-        os << "\n";
+    printIndent(os, indent);     os << "(UnaryOp\n";
+    printIndent(os, indent + 1);     os << "(Operator " << program.symbols.name(op) << ")\n";
+                                     program.toString(operand, os, indent + 1); os << "\n";
     printIndent(os, indent);     os << ")";
 }
 
 // ---------------------------
 
-FunctionCall::FunctionCall(const std::string& name, NodePtrList arguments) :
-    name(name), arguments(std::move(arguments))
-    , Node("function call")
+FunctionCall::FunctionCall(Symbol name, NodeList arguments) :
+    name(name), arguments(arguments)
+    , Node(NodeKind::FunctionCall)
 {}
 
-void FunctionCall::toString(std::ostream& os, std::size_t indent)
+void FunctionCall::toString(const Program& program, std::ostream& os, std::size_t indent) const
 {
     printIndent(os, indent);     os << "(FunctionCall\n";
-    printIndent(os, indent + 1);     os << "(Name " << name << ")\n";
+    printIndent(os, indent + 1);     os << "(Name " << program.symbols.name(name) << ")\n";
     printIndent(os, indent + 1);     os << "(Args";
-    for (auto& node: arguments)
+    for (NodeRef node: program.slice(arguments))
     {
         os << "\n";
-        node->toString(os, indent + 2);
+        program.toString(node, os, indent + 2);
     }
-    if (arguments.size() > 0)
+    if (arguments.count > 0)
     {
         os << "\n";
         printIndent(os, indent + 1);
@@ -304,23 +455,23 @@ void FunctionCall::toString(std::ostream& os, std::size_t indent)
 
 // ---------------------------
 
-MethodCall::MethodCall(const std::string& classname, const std::string& funcname, NodePtrList arguments) :
-    classname(classname), funcname(funcname), arguments(std::move(arguments))
-    , Node ("method call")
+MethodCall::MethodCall(Symbol classname, Symbol funcname, NodeList arguments) :
+    classname(classname), funcname(funcname), arguments(arguments)
+    , Node(NodeKind::MethodCall)
 {}
 
-void MethodCall::toString(std::ostream& os, std::size_t indent)
+void MethodCall::toString(const Program& program, std::ostream& os, std::size_t indent) const
 {
     printIndent(os, indent);     os << "(MethodCall\n";
-    printIndent(os, indent + 1);     os << "(ClassName " << classname << ")\n";
-    printIndent(os, indent + 1);     os << "(FuncName " << funcname << ")\n";
+    printIndent(os, indent + 1);     os << "(ClassName " << program.symbols.name(classname) << ")\n";
+    printIndent(os, indent + 1);     os << "(FuncName " << program.symbols.name(funcname) << ")\n";
     printIndent(os, indent + 1);     os << "(Args";
-    for (auto& node: arguments)
+    for (NodeRef node: program.slice(arguments))
     {
         os << "\n";
-        node->toString(os, indent + 2);
+        program.toString(node, os, indent + 2);
     }
-    if (arguments.size() > 0)
+    if (arguments.count > 0)
     {
         os << "\n";
         printIndent(os, indent + 1);
@@ -331,22 +482,22 @@ void MethodCall::toString(std::ostream& os, std::size_t indent)
 
 // ---------------------------
 
-ClassInstanciation::ClassInstanciation(const std::string& name, NodePtrList arguments) :
-    name(name), arguments(std::move(arguments))
-    , Node("class instanciation")
+ClassInstanciation::ClassInstanciation(Symbol name, NodeList arguments) :
+    name(name), arguments(arguments)
+    , Node(NodeKind::ClassInstanciation)
 {}
 
-void ClassInstanciation::toString(std::ostream& os, std::size_t indent)
+void ClassInstanciation::toString(const Program& program, std::ostream& os, std::size_t indent) const
 {
     printIndent(os, indent);     os << "(ClassInstanciation\n";
-    printIndent(os, indent + 1);     os << "(Name " << name << ")\n";
+    printIndent(os, indent + 1);     os << "(Name " << program.symbols.name(name) << ")\n";
     printIndent(os, indent + 1);     os << "(Args";
-    for (auto& node: arguments)
+    for (NodeRef node: program.slice(arguments))
     {
         os << "\n";
-        node->toString(os, indent + 2);
+        program.toString(node, os, indent + 2);
     }
-    if (arguments.size() > 0)
+    if (arguments.count > 0)
     {
         os << "\n";
         printIndent(os, indent + 1);
@@ -357,34 +508,34 @@ void ClassInstanciation::toString(std::ostream& os, std::size_t indent)
 
 // ---------------------------
 
-ClsConstructor::ClsConstructor(const std::string& name, NodePtrList arguments, NodePtrList body) :
-    name(name), arguments(std::move(arguments)), body(std::move(body))
-    , Node("class constructor")
+ClsConstructor::ClsConstructor(Symbol name, NodeList arguments, NodeList body) :
+    name(name), arguments(arguments), body(body)
+    , Node(NodeKind::ClsConstructor)
 {}
 
-void ClsConstructor::toString(std::ostream& os, std::size_t indent)
+void ClsConstructor::toString(const Program& program, std::ostream& os, std::size_t indent) const
 {
     printIndent(os, indent);     os << "(ClassConstructor\n";
-    printIndent(os, indent + 1);     os << "(Name " << name << ")\n";
+    printIndent(os, indent + 1);     os << "(Name " << program.symbols.name(name) << ")\n";
     printIndent(os, indent + 1);     os << "(Args";
-    for (auto& node: arguments)
+    for (NodeRef node: program.slice(arguments))
     {
         os << "\n";
-        node->toString(os, indent + 2);
+        program.toString(node, os, indent + 2);
     }
-    if (arguments.size() > 0)
+    if (arguments.count > 0)
     {
         os << "\n";
         printIndent(os, indent + 1);
     }
     os << ")\n";
     printIndent(os, indent + 1);     os << "(Body";
-    for (auto& node: body)
+    for (NodeRef node: program.slice(body))
     {
         os << "\n";
-        node->toString(os, indent + 2);
+        program.toString(node, os, indent + 2);
     }
-    if (body.size() > 0)
+    if (body.count > 0)
     {
         os << "\n";
         printIndent(os, indent + 1);
@@ -396,10 +547,10 @@ void ClsConstructor::toString(std::ostream& os, std::size_t indent)
 // ---------------------------
 
 End::End() :
-    Node("end")
+    Node(NodeKind::End)
 {}
 
-void End::toString(std::ostream& os, std::size_t indent)
+void End::toString(const Program&, std::ostream& os, std::size_t indent) const
 {
     printIndent(os, indent);     os << "(End)";
 }
@@ -407,10 +558,10 @@ void End::toString(std::ostream& os, std::size_t indent)
 // ---------------------------
 
 Elif::Elif() :
-    Node("elif")
+    Node(NodeKind::Elif)
 {}
 
-void Elif::toString(std::ostream& os, std::size_t indent)
+void Elif::toString(const Program&, std::ostream& os, std::size_t indent) const
 {
     printIndent(os, indent);     os << "(Elif)";
 }
@@ -418,25 +569,25 @@ void Elif::toString(std::ostream& os, std::size_t indent)
 // ---------------------------
 
 Else::Else() :
-    Node("else")
+    Node(NodeKind::Else)
 {}
 
-void Else::toString(std::ostream& os, std::size_t indent)
+void Else::toString(const Program&, std::ostream& os, std::size_t indent) const
 {
     printIndent(os, indent);     os << "(Else)";
 }
 
 // ---------------------------
 
-Ret::Ret(NodePtr value) :
-    value(std::move(value))
-    , Node("ret")
+Ret::Ret(NodeRef value) :
+    value(value)
+    , Node(NodeKind::Ret)
 {}
 
-void Ret::toString(std::ostream& os, std::size_t indent)
+void Ret::toString(const Program& program, std::ostream& os, std::size_t indent) const
 {
     printIndent(os, indent);     os << "(Ret\n";
-    value->toString(os, indent + 1);
+    program.toString(value, os, indent + 1);
     os << "\n";
     printIndent(os, indent);     os << ")";
 }
\ No newline at end of file
@@ -1,19 +1,13 @@
 #include <kafe/internal/parser.hpp>
+#include <kafe/internal/scan.hpp>
 #include <iostream>
 
 using namespace kafe::internal;
 
-ParserCombinators::ParserCombinators(const std::string& s) :
-    m_in(s), m_count(0), m_row(1), m_col(1)
+ParserCombinators::ParserCombinators(std::string_view s) :
+    m_in(s), m_count(0), m_lines(s)
 {
-    // if the input string is empty, raise an error
-    if (s.size() == 0)
-    {
-        m_sym = EOF;
-        error("Expected symbol, got empty string", "");
-    }
-
-    // otherwise, get the first symbol
+    // get the first symbol, an empty string starts directly on the final '\0'
     next();
 }
 
@@ -22,33 +16,38 @@ ParserCombinators::~ParserCombinators()
 
 void ParserCombinators::next()
 {
+    // once the end of the string is reached, stay on the final '\0'
+    if (m_count >= m_in.size())
+    {
+        m_sym = '\0';
+        m_count = m_in.size() + 1;
+        return;
+    }
+
     // getting a character from the stream
     m_sym = m_in[m_count];
     ++m_count;
+}
 
-    // new line
-    if (m_sym == '\n')
-    {
-        ++m_row;
-        m_col = 1;
-    }
-    else if (std::isprint(m_sym))
-    {
-        ++m_col;
-    }
+void ParserCombinators::advance(std::size_t n)
+{
+    // no need to look at the skipped characters, only the offset matters
+    m_count += n - 1;
+    next();
 }
 
 int ParserCombinators::getCol()
 {
-    return m_col;
+    // m_count is the position of the symbol *after* the current one
+    return m_lines.position(m_count > 0 ? m_count - 1 : 0).col;
 }
 
 int ParserCombinators::getRow()
 {
-    return m_row;
+    return m_lines.position(m_count > 0 ? m_count - 1 : 0).row;
 }
 
-int ParserCombinators::getCount()
+std::size_t ParserCombinators::getCount()
 {
     return m_count;
 }
@@ -58,53 +57,42 @@ std::size_t ParserCombinators::getSize()
     return m_in.size();
 }
 
-bool ParserCombinators::isEOF()
+std::string_view ParserCombinators::getInput()
 {
-    return m_count >= m_in.size() || m_sym == '\0';
+    return m_in;
 }
 
-void ParserCombinators::back(std::size_t n)
+bool ParserCombinators::isEOF()
 {
-    // going back into the string and adjusting the rows count
-    for (std::size_t i=0; i < n && m_count > 0; i++)
-    {
-        m_sym = m_in[m_count];
-        --m_count;
-
-        if (m_sym == '\n')
-            --m_row;
-    }
-
-    // adjusting the columns count
-    int count = m_count;
-    while (m_in[count] != '\n' && count != 0)
-        --count;
-    m_col = m_count - count;
+    // m_count is the position of the symbol *after* the current one
+    return m_count > m_in.size() || m_sym == '\0';
+}
 
-    next();  // getting the 'new' current character
+ParserCombinators::Checkpoint ParserCombinators::save()
+{
+    return Checkpoint { m_count, m_sym };
 }
 
-bool ParserCombinators::accept(const CharPred& t, std::string* s)
+void ParserCombinators::restore(const Checkpoint& checkpoint)
 {
-    // return false if the predicate couldn't consume the symbol
-    if (!t(m_sym))
-        return false;
-    // otherwise, add it to the string and go to the next symbol
-    if (s != nullptr)
-        s->push_back(m_sym);
-    next();
-    return true;
+    // everything needed is in the checkpoint, no need to walk back in the string
+    m_count = checkpoint.count;
+    m_sym = checkpoint.sym;
 }
 
-bool ParserCombinators::except(const CharPred& t, std::string* s)
+bool ParserCombinators::acceptRun(std::size_t (*scanner)(const char*, std::size_t), std::string* s)
 {
-    // throw an error if the predicate couldn't consume the symbol
-    if (!t(m_sym))
-        error("Expected", t.name);
-    // otherwise, add it to the string and go to the next symbol
+    if (isEOF())
+        return false;
+
+    std::size_t offset = m_count - 1;
+    std::size_t n = scanner(m_in.data() + offset, m_in.size() - offset);
+    if (n == 0)
+        return false;
+
     if (s != nullptr)
-        s->push_back(m_sym);
-    next();
+        s->append(m_in.substr(offset, n));
+    advance(n);
     return true;
 }
 
@@ -144,7 +132,7 @@ bool ParserCombinators::name(std::string* s)
     if (accept(IsAlpha, s))
     {
         // the next ones can be alphanumeric, or '_'
-        while (accept(IsAlnum, s) || accept(IsChar('_'), s));
+        acceptRun(scan::wordChars, s);
         return true;
     }
     return false;
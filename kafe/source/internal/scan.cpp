@@ -0,0 +1,259 @@
+#include <kafe/internal/scan.hpp>
+#include <kafe/internal/charpred.hpp>
+
+#include <cstdint>
+
+#if defined(__x86_64__) || defined(_M_X64) || (defined(__i386__) && defined(__SSE2__))
+    #define KAFE_SCAN_SSE2
+    #include <emmintrin.h>
+
+    // AVX2 code is compiled with target attributes and only run if the CPU supports it
+    #if defined(__GNUC__) || defined(__clang__)
+        #define KAFE_SCAN_AVX2
+        #include <immintrin.h>
+    #endif
+#endif
+
+#if defined(_MSC_VER)
+    #include <intrin.h>
+#endif
+
+using namespace kafe::internal;
+
+namespace
+{
+    /*
+        Set of characters described by up to 4 ranges, so that the vectorised
+        code only needs comparisons. The bounds must be between 0x01 and 0x7e,
+        unused ranges are empty (lo > hi).
+    */
+    struct CharSet
+    {
+        char lo[4];
+        char hi[4];
+        bool negate;      // match the characters outside of the ranges
+        CharTable table;  // the same set, for the scalar code
+    };
+
+    constexpr CharSet g_inlineSpaces { { ' ', '\t', '\v', 1 }, { ' ', '\t', '\f', 0 }, false, IsInlineSpace.table };
+    constexpr CharSet g_wordChars    { { 'a', 'A', '0', '_' }, { 'z', 'Z', '9', '_' }, false, IsWordChar.table };
+    constexpr CharSet g_notNewLine   { { '\n', 1, 1, 1 }, { '\n', 0, 0, 0 }, true, ~CharTable::of("\n") };
+    constexpr CharSet g_notQuote     { { '"', 1, 1, 1 }, { '"', 0, 0, 0 }, true, ~CharTable::of("\"") };
+    constexpr CharSet g_newLine      { { '\n', 1, 1, 1 }, { '\n', 0, 0, 0 }, false, CharTable::of("\n") };
+
+    inline unsigned countTrailingZeros(std::uint32_t x)
+    {
+#if defined(_MSC_VER)
+        unsigned long index;
+        _BitScanForward(&index, x);
+        return static_cast<unsigned>(index);
+#else
+        return static_cast<unsigned>(__builtin_ctz(x));
+#endif
+    }
+
+    inline unsigned popCount(std::uint32_t x)
+    {
+#if defined(_MSC_VER)
+        // no guarantee that the popcnt instruction is available
+        x = x - ((x >> 1) & 0x55555555);
+        x = (x & 0x33333333) + ((x >> 2) & 0x33333333);
+        return static_cast<unsigned>((((x + (x >> 4)) & 0x0F0F0F0F) * 0x01010101) >> 24);
+#else
+        return static_cast<unsigned>(__builtin_popcount(x));
+#endif
+    }
+
+    // ---------------------------
+
+    std::size_t spanScalar(const char* data, std::size_t size, const CharSet& set)
+    {
+        std::size_t i = 0;
+        while (i < size && set.table.contains(data[i]))
+            ++i;
+        return i;
+    }
+
+    std::size_t countScalar(const char* data, std::size_t size, const CharSet& set)
+    {
+        std::size_t n = 0;
+        for (std::size_t i=0; i < size; ++i)
+            n += set.table.contains(data[i]) ? 1 : 0;
+        return n;
+    }
+
+    // ---------------------------
+
+#ifdef KAFE_SCAN_SSE2
+    struct Sse2Set
+    {
+        __m128i lo[4];
+        __m128i hi[4];
+        bool negate;
+
+        explicit Sse2Set(const CharSet& set) :
+            negate(set.negate)
+        {
+            // signed comparisons are fine, all the bounds are ASCII
+            for (int i=0; i < 4; ++i)
+            {
+                lo[i] = _mm_set1_epi8(static_cast<char>(set.lo[i] - 1));
+                hi[i] = _mm_set1_epi8(static_cast<char>(set.hi[i] + 1));
+            }
+        }
+
+        // one bit per character of the block, set if it is in the set
+        inline std::uint32_t match(const char* p) const
+        {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+            __m128i m = _mm_setzero_si128();
+            for (int i=0; i < 4; ++i)
+                m = _mm_or_si128(m, _mm_and_si128(_mm_cmpgt_epi8(v, lo[i]), _mm_cmpgt_epi8(hi[i], v)));
+
+            std::uint32_t bits = static_cast<std::uint32_t>(_mm_movemask_epi8(m));
+            return negate ? (~bits & 0xFFFF) : bits;
+        }
+    };
+
+    std::size_t spanSse2(const char* data, std::size_t size, const CharSet& set)
+    {
+        Sse2Set s(set);
+        std::size_t i = 0;
+        for (; i + 16 <= size; i += 16)
+        {
+            std::uint32_t bits = s.match(data + i);
+            if (bits != 0xFFFF)
+                return i + countTrailingZeros(~bits);
+        }
+        return i + spanScalar(data + i, size - i, set);
+    }
+
+    std::size_t countSse2(const char* data, std::size_t size, const CharSet& set)
+    {
+        Sse2Set s(set);
+        std::size_t i = 0;
+        std::size_t n = 0;
+        for (; i + 16 <= size; i += 16)
+            n += popCount(s.match(data + i));
+        return n + countScalar(data + i, size - i, set);
+    }
+#endif
+
+    // ---------------------------
+
+#ifdef KAFE_SCAN_AVX2
+    struct Avx2Set
+    {
+        __m256i lo[4];
+        __m256i hi[4];
+        bool negate;
+
+        __attribute__((target("avx2"))) explicit Avx2Set(const CharSet& set) :
+            negate(set.negate)
+        {
+            for (int i=0; i < 4; ++i)
+            {
+                lo[i] = _mm256_set1_epi8(static_cast<char>(set.lo[i] - 1));
+                hi[i] = _mm256_set1_epi8(static_cast<char>(set.hi[i] + 1));
+            }
+        }
+
+        __attribute__((target("avx2"))) inline std::uint32_t match(const char* p) const
+        {
+            __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+            __m256i m = _mm256_setzero_si256();
+            for (int i=0; i < 4; ++i)
+                m = _mm256_or_si256(m, _mm256_and_si256(_mm256_cmpgt_epi8(v, lo[i]), _mm256_cmpgt_epi8(hi[i], v)));
+
+            std::uint32_t bits = static_cast<std::uint32_t>(_mm256_movemask_epi8(m));
+            return negate ? ~bits : bits;
+        }
+    };
+
+    __attribute__((target("avx2"))) std::size_t spanAvx2(const char* data, std::size_t size, const CharSet& set)
+    {
+        Avx2Set s(set);
+        std::size_t i = 0;
+        for (; i + 32 <= size; i += 32)
+        {
+            std::uint32_t bits = s.match(data + i);
+            if (bits != 0xFFFFFFFF)
+                return i + countTrailingZeros(~bits);
+        }
+        return i + spanSse2(data + i, size - i, set);
+    }
+
+    __attribute__((target("avx2"))) std::size_t countAvx2(const char* data, std::size_t size, const CharSet& set)
+    {
+        Avx2Set s(set);
+        std::size_t i = 0;
+        std::size_t n = 0;
+        for (; i + 32 <= size; i += 32)
+            n += popCount(s.match(data + i));
+        return n + countSse2(data + i, size - i, set);
+    }
+#endif
+
+    // ---------------------------
+
+    struct Implementation
+    {
+        const char* name;
+        std::size_t (*span)(const char*, std::size_t, const CharSet&);
+        std::size_t (*count)(const char*, std::size_t, const CharSet&);
+    };
+
+    Implementation detect()
+    {
+#ifdef KAFE_SCAN_AVX2
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2"))
+            return Implementation { "avx2", &spanAvx2, &countAvx2 };
+#endif
+#ifdef KAFE_SCAN_SSE2
+        return Implementation { "sse2", &spanSse2, &countSse2 };
+#else
+        return Implementation { "scalar", &spanScalar, &countScalar };
+#endif
+    }
+
+    const Implementation& selected()
+    {
+        // checking the CPU only once
+        static const Implementation impl = detect();
+        return impl;
+    }
+}
+
+std::size_t scan::inlineSpaces(const char* data, std::size_t size)
+{
+    // most runs are a single space, don't pay for the vector setup
+    if (size == 0 || !g_inlineSpaces.table.contains(data[0]))
+        return 0;
+    return selected().span(data, size, g_inlineSpaces);
+}
+
+std::size_t scan::wordChars(const char* data, std::size_t size)
+{
+    return selected().span(data, size, g_wordChars);
+}
+
+std::size_t scan::untilNewLine(const char* data, std::size_t size)
+{
+    return selected().span(data, size, g_notNewLine);
+}
+
+std::size_t scan::untilQuote(const char* data, std::size_t size)
+{
+    return selected().span(data, size, g_notQuote);
+}
+
+std::size_t scan::countNewLines(const char* data, std::size_t size)
+{
+    return selected().count(data, size, g_newLine);
+}
+
+const char* scan::implementation()
+{
+    return selected().name;
+}
@@ -0,0 +1,133 @@
+#include <kafe/internal/threadpool.hpp>
+
+#include <algorithm>
+#include <utility>
+
+using namespace kafe::internal;
+
+namespace
+{
+    // pool and queue of the current thread, when it belongs to a pool
+    thread_local ThreadPool* t_pool = nullptr;
+    thread_local std::size_t t_queue = 0;
+}
+
+ThreadPool::ThreadPool(std::size_t threads) :
+    m_nextQueue(0), m_queued(0), m_pending(0), m_stopping(false)
+{
+    if (threads == 0)
+        threads = std::max(1u, std::thread::hardware_concurrency());
+
+    for (std::size_t i = 0; i < threads; ++i)
+        m_queues.push_back(std::make_unique<Queue>());
+
+    m_threads.reserve(threads);
+    for (std::size_t i = 0; i < threads; ++i)
+        m_threads.emplace_back(&ThreadPool::work, this, i);
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_jobsDone.wait(lock, [this] { return m_pending == 0; });
+        m_stopping = true;
+    }
+    m_jobAdded.notify_all();
+
+    for (std::thread& thread : m_threads)
+        thread.join();
+}
+
+void ThreadPool::submit(std::function<void()> job)
+{
+    {
+        // counted first, so that it can't be taken (and finished) before, and under
+        // the lock, so that a thread going to sleep can't miss it
+        std::lock_guard<std::mutex> lock(m_mutex);
+        ++m_pending;
+        ++m_queued;
+    }
+
+    std::size_t index = t_pool == this ? t_queue : m_nextQueue++ % m_queues.size();
+    {
+        std::lock_guard<std::mutex> lock(m_queues[index]->mutex);
+        m_queues[index]->jobs.push_back(std::move(job));
+    }
+    m_jobAdded.notify_one();
+}
+
+void ThreadPool::wait()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_jobsDone.wait(lock, [this] { return m_pending == 0; });
+
+    if (m_error)
+        std::rethrow_exception(std::exchange(m_error, nullptr));
+}
+
+std::size_t ThreadPool::size() const
+{
+    return m_threads.size();
+}
+
+void ThreadPool::work(std::size_t index)
+{
+    t_pool = this;
+    t_queue = index;
+
+    while (true)
+    {
+        std::function<void()> job;
+        if (!take(index, job))
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_jobAdded.wait(lock, [this] { return m_stopping || m_queued > 0; });
+            if (m_stopping && m_queued == 0)
+                return;
+            continue;
+        }
+
+        std::exception_ptr error;
+        try
+        {
+            job();
+        }
+        catch (...)
+        {
+            error = std::current_exception();
+        }
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (error && !m_error)
+            m_error = error;
+        if (--m_pending == 0)
+            m_jobsDone.notify_all();
+    }
+}
+
+bool ThreadPool::take(std::size_t index, std::function<void()>& job)
+{
+    // the newest job of its own queue is the most likely to still be in cache
+    for (std::size_t i = 0; i < m_queues.size(); ++i)
+    {
+        Queue& queue = *m_queues[(index + i) % m_queues.size()];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (queue.jobs.empty())
+            continue;
+
+        if (i == 0)
+        {
+            job = std::move(queue.jobs.back());
+            queue.jobs.pop_back();
+        }
+        else
+        {
+            job = std::move(queue.jobs.front());
+            queue.jobs.pop_front();
+        }
+        --m_queued;
+        return true;
+    }
+    return false;
+}
@@ -1,29 +1,402 @@
 #include <kafe/parser.hpp>
+#include <kafe/internal/compiler.hpp>
+#include <kafe/internal/threadpool.hpp>
+
+#include <algorithm>
+#include <charconv>
+#include <limits>
+#include <stdexcept>
+#include <thread>
 
 using namespace kafe;
 using namespace kafe::internal;
 
-Parser::Parser(const std::string& code) :
-    internal::ParserCombinators(code)
+namespace
+{
+    struct BinaryOperator
+    {
+        std::string_view name;
+        int precedence;
+    };
+
+    // all the binary operators are left associative
+    const BinaryOperator g_binaryOperators[] = {
+        { "or",  1 },
+        { "and", 2 },
+        // 'not' comes here: not a == b is not (a == b)
+        { "==",  4 }, { "!=", 4 }, { "<",  4 }, { ">",  4 }, { "<=", 4 }, { ">=", 4 },
+        { "<<",  5 }, { ">>", 5 },
+        { "+",   6 }, { "-",  6 },
+        { "*",   7 }, { "/",  7 }
+        // the prefix '-' and '~' bind tighter than all of them
+    };
+
+    // the operand of 'not' takes all the operators binding tighter than 'and'
+    const int g_notOperandPrecedence = 4;
+
+    // the literal without its digit separators, copied only if there are some
+    std::string_view withoutSeparators(std::string_view literal, std::string& storage)
+    {
+        if (literal.find('_') == std::string_view::npos)
+            return literal;
+
+        storage.reserve(literal.size());
+        for (char c : literal)
+        {
+            if (c != '_')
+                storage.push_back(c);
+        }
+        return storage;
+    }
+
+    // integer literal given by the lexer, false if it doesn't fit in 64 bits
+    bool toInteger(std::string_view literal, std::int64_t& value)
+    {
+        std::string storage;
+        literal = withoutSeparators(literal, storage);
+
+        bool negative = literal[0] == '-';
+        if (negative)
+            literal.remove_prefix(1);
+
+        int base = 10;
+        if (literal.size() > 2 && literal[0] == '0' && (literal[1] == 'x' || literal[1] == 'b'))
+        {
+            base = literal[1] == 'x' ? 16 : 2;
+            literal.remove_prefix(2);
+        }
+
+        std::uint64_t magnitude = 0;
+        auto result = std::from_chars(literal.data(), literal.data() + literal.size(), magnitude, base);
+        if (result.ec != std::errc())
+            return false;
+
+        // there is one more negative number than positive ones
+        const std::uint64_t max = std::numeric_limits<std::int64_t>::max();
+        if (magnitude > max + (negative ? 1 : 0))
+            return false;
+
+        if (negative)
+            value = magnitude == 0 ? 0 : -static_cast<std::int64_t>(magnitude - 1) - 1;
+        else
+            value = static_cast<std::int64_t>(magnitude);
+        return true;
+    }
+
+    // float literal given by the lexer, false if it doesn't fit in a float
+    bool toFloat(std::string_view literal, float& value)
+    {
+        std::string storage;
+        literal = withoutSeparators(literal, storage);
+
+        auto result = std::from_chars(literal.data(), literal.data() + literal.size(), value);
+        return result.ec == std::errc();
+    }
+}
+
+Parser::Parser(std::string_view code) :
+    m_code(code), m_lines(m_code), m_pos(0), m_fileId(0),
+    m_errorMode(ErrorMode::Throw), m_failed(false), m_packrat(false), m_packratHits(0), m_packratEpoch(1), m_threads(1), m_garbageNodes(0)
+{
+    lex();
+}
+
+Parser::Parser(const char* code) :
+    Parser(std::string_view(code))
 {}
 
+Parser::Parser(std::string&& code) :
+    m_ownedCode(std::make_unique<std::string>(std::move(code))), m_code(*m_ownedCode), m_lines(m_code), m_pos(0), m_fileId(0),
+    m_errorMode(ErrorMode::Throw), m_failed(false), m_packrat(false), m_packratHits(0), m_packratEpoch(1), m_threads(1), m_garbageNodes(0)
+{
+    lex();
+}
+
+Parser::Parser(MappedFile file) :
+    m_file(std::move(file)), m_code(m_file->view()), m_lines(m_code), m_pos(0), m_fileId(0),
+    m_errorMode(ErrorMode::Throw), m_failed(false), m_packrat(false), m_packratHits(0), m_packratEpoch(1), m_threads(1), m_garbageNodes(0)
+{
+    lex();
+}
+
+Parser::Parser(std::string_view code, TokenList tokens) :
+    m_code(code), m_lines(m_code), m_tokens(std::move(tokens)), m_pos(0), m_fileId(0),
+    m_errorMode(ErrorMode::Throw), m_failed(false), m_packrat(false), m_packratHits(0), m_packratEpoch(1), m_threads(1), m_garbageNodes(0)
+{}
+
+Parser Parser::fromFile(const std::string& path)
+{
+    return Parser(MappedFile(path));
+}
+
 Parser::~Parser()
 {}
 
+void Parser::lex()
+{
+    // lexing everything once, the parsers only work on tokens
+    Lexer lexer(m_code);
+    m_tokens = lexer.tokenize();
+}
+
+void Parser::restart(TokenList tokens)
+{
+    m_tokens = std::move(tokens);
+    m_pos = 0;
+    m_failed = false;
+    // the cache was filled with the previous tokens, the hits keep adding up
+    clearPackratCache();
+}
+
 void Parser::parse()
 {
+    // the parallel mode falls back to a single thread to report the errors
+    if (m_threads != 1 && m_pos == 0 && parseParallel())
+        return;
+
     // parse until the end of the string
-    while (!isEOF())
+    while (next());
+}
+
+std::vector<std::size_t> Parser::topLevelSplits(std::size_t parts)
+{
+    std::vector<std::size_t> splits { 0 };
+    std::size_t partSize = m_tokens.size() / parts;
+
+    // the blocks opened (true for a class), only the lines outside of them start a top-level instruction
+    std::vector<bool> blocks;
+    for (std::size_t i = 0; i + 1 < m_tokens.size(); ++i)
     {
-        MaybeNodePtr inst = parseInstruction();
-        if (!inst)
-        {
-            std::cout << "[Parser] Error, couldn't recognize instruction" << std::endl;
-            break;
-        }
-        else
-            m_program.children.push_back(std::move(inst.value()));
+        if (i > 0 && m_tokens[i - 1].type != TokenType::NewLine)
+            continue;
+
+        if (blocks.empty() && i >= splits.back() + partSize && splits.size() < parts)
+            splits.push_back(i);
+
+        if (isBlockStart(i, !blocks.empty() && blocks.back()))
+            blocks.push_back(m_tokens[i].type == TokenType::Cls);
+        else if (m_tokens[i].type == TokenType::End && !blocks.empty())
+            blocks.pop_back();
     }
+
+    return splits;
+}
+
+bool Parser::parseParallel()
+{
+    // small parts aren't worth a thread, a few parts per thread balance the work
+    const std::size_t minPartSize = 16 * 1024;
+    std::size_t threads = m_threads != 0 ? m_threads : std::max(1u, std::thread::hardware_concurrency());
+    std::size_t parts = std::min(threads * 4, m_tokens.size() / minPartSize);
+    if (threads < 2 || parts < 2)
+        return false;
+
+    ThreadPool pool(threads);
+
+    std::vector<std::size_t> splits = topLevelSplits(parts);
+    splits.push_back(m_tokens.size() - 1);
+
+    std::vector<std::unique_ptr<Parser>> parsers(splits.size() - 1);
+    for (std::size_t i = 0; i < parsers.size(); ++i)
+    {
+        pool.submit([this, &splits, &parsers, i] {
+            // each part ends with its own end of file
+            TokenList tokens(m_tokens.begin() + splits[i], m_tokens.begin() + splits[i + 1]);
+            tokens.push_back(Token { TokenType::EndOfFile, m_tokens[splits[i + 1]].offset, 0 });
+
+            std::unique_ptr<Parser> parser(new Parser(m_code, std::move(tokens)));
+            parser->m_fileId = m_fileId;
+            parser->setPackrat(m_packrat);
+            // the errors are reported by parsing everything again on a single thread
+            parser->setErrorMode(ErrorMode::Collect);
+            parser->parse();
+            parsers[i] = std::move(parser);
+        });
+    }
+    pool.wait();
+
+    for (const auto& parser : parsers)
+    {
+        if (parser->m_failed || !parser->isEOF())
+            return false;
+    }
+
+    // merging in order gives the same nodes and symbols as a single thread
+    NodeRef nodes = static_cast<NodeRef>(m_program.size());
+    std::uint32_t lists = static_cast<std::uint32_t>(m_program.listsSize());
+    std::vector<std::vector<Symbol>> symbols(parsers.size());
+    for (std::size_t i = 0; i < parsers.size(); ++i)
+    {
+        Program& part = parsers[i]->m_program;
+        symbols[i] = part.symbolsIn(m_program.symbols);
+        pool.submit([&part, &symbols, nodes, lists, i] { part.relocate(nodes, lists, symbols[i]); });
+
+        nodes += static_cast<NodeRef>(part.size());
+        lists += static_cast<std::uint32_t>(part.listsSize());
+    }
+    pool.wait();
+
+    for (auto& parser : parsers)
+    {
+        m_packratHits += parser->m_packratHits;
+        m_program.append(std::move(parser->m_program));
+    }
+    m_pos = m_tokens.size() - 1;
+    return true;
+}
+
+MaybeNodeRef Parser::next()
+{
+    // skip the empty lines between instructions
+    while (accept(TokenType::NewLine));
+    if (isEOF())
+        return {};
+
+    MaybeNodeRef inst = parseInstructionOrRecover();
+    // in collect mode, the error is already in the diagnostics
+    if (m_failed)
+        return {};
+    // the error recovery may have skipped the last instructions
+    else if (!inst && isEOF())
+        return {};
+    else if (!inst)
+    {
+        std::cout << "[Parser] Error, couldn't recognize instruction" << std::endl;
+        return {};
+    }
+
+    m_program.children.push_back(inst.value());
+    return inst;
+}
+
+void Parser::release()
+{
+    m_program.clear();
+    m_garbageNodes = 0;
+    ++m_packratEpoch;
+}
+
+void Parser::parse(const std::function<void(Program&, NodeRef)>& callback)
+{
+    while (MaybeNodeRef inst = next())
+    {
+        callback(m_program, inst.value());
+        release();
+    }
+}
+
+void Parser::reparse(std::string_view code, const Edit& edit)
+{
+    std::size_t oldSize = m_code.size();
+    if (edit.offset + static_cast<std::size_t>(edit.oldLength) > oldSize ||
+        oldSize - edit.oldLength + edit.newLength != code.size())
+        throw std::invalid_argument("The edit doesn't match the size of the code");
+
+    // the previous parsing stopped on an error (or never ran), the end of the code is missing
+    bool complete = isEOF() && !m_failed && m_diagnostics.empty();
+
+    m_code = code;
+    m_lines = LineIndex(m_code);
+
+    /*
+        The diagnostics positions would have to be moved too, starting over is simpler.
+        The same when most of the arena holds replaced instructions: parsing everything
+        again costs about as much as the edits which left them there.
+    */
+    if (!complete || !reparseEdited(oldSize, edit) || m_garbageNodes * 2 >= m_program.size())
+    {
+        m_program.clear();
+        m_garbageNodes = 0;
+        m_diagnostics.clear();
+        restart(Lexer(m_code).tokenize());
+        parse();
+    }
+}
+
+bool Parser::reparseEdited(std::size_t oldSize, const Edit& edit)
+{
+    std::vector<NodeRef>& children = m_program.children;
+    auto spanOf = [this](NodeRef ref) -> const Span& { return m_program.get(ref).span; };
+
+    // the length of a huge instruction isn't known, nor where the next one starts
+    for (NodeRef child : children)
+    {
+        if (spanOf(child).length == Span::MaxLength)
+            return false;
+    }
+
+    /*
+        The top-level instructions are sorted, keep the ones whose lines are strictly before
+        or after the edit: the rest of a line matters too (eg a comment becoming code).
+        The code before the edit didn't change, neither did the code after it once moved.
+    */
+    std::int64_t delta = static_cast<std::int64_t>(edit.newLength) - edit.oldLength;
+    std::uint32_t editEnd = edit.offset + edit.oldLength;
+    std::size_t newEditEnd = edit.offset + static_cast<std::size_t>(edit.newLength);
+
+    auto first = std::partition_point(children.begin(), children.end(), [&](NodeRef child) {
+        return m_code.find('\n', spanOf(child).offset + spanOf(child).length) < edit.offset;
+    });
+    auto last = std::partition_point(first, children.end(), [&](NodeRef child) {
+        if (spanOf(child).offset <= editEnd)
+            return true;
+        std::size_t previousLine = m_code.rfind('\n', spanOf(child).offset + delta - 1);
+        return previousLine == std::string_view::npos || previousLine < newEditEnd;
+    });
+
+    // the text between the kept instructions, in the new code
+    std::size_t begin = first == children.begin() ? 0 : spanOf(*(first - 1)).offset + spanOf(*(first - 1)).length;
+    std::size_t end = (last == children.end() ? oldSize : spanOf(*last).offset) + delta;
+
+    TokenList tokens = Lexer(m_code.substr(begin, end - begin)).tokenize();
+    for (Token& token : tokens)
+        token.offset += static_cast<std::uint32_t>(begin);
+
+    std::vector<NodeRef> before(children.begin(), first);
+    std::vector<NodeRef> after(last, children.end());
+    std::size_t replaced = 0;
+    for (auto it = first; it != last; ++it)
+        replaced += nodeCount(*it);
+
+    // errors are only collected, the whole code is parsed again to report them
+    ErrorMode mode = m_errorMode;
+    m_errorMode = ErrorMode::Collect;
+    restart(std::move(tokens));
+    children.clear();
+    std::size_t size = m_program.size();
+    parse();
+    m_errorMode = mode;
+
+    if (m_failed || !isEOF())
+        return false;
+
+    /*
+        The nodes of the replaced instructions stay in the arena until the next full parsing,
+        with the ones made by the parsers which backtracked.
+    */
+    m_garbageNodes += replaced + m_program.size() - size;
+    for (NodeRef child : children)
+        m_garbageNodes -= nodeCount(child);
+    for (NodeRef child : after)
+        moveSpans(child, delta);
+
+    children.insert(children.begin(), before.begin(), before.end());
+    children.insert(children.end(), after.begin(), after.end());
+    return true;
+}
+
+void Parser::moveSpans(NodeRef node, std::int64_t delta)
+{
+    Span& span = m_program.get(node).span;
+    span.offset = static_cast<std::uint32_t>(span.offset + delta);
+    forEachChild(m_program, node, [&](NodeRef child) { moveSpans(child, delta); });
+}
+
+std::size_t Parser::nodeCount(NodeRef node)
+{
+    std::size_t count = 1;
+    forEachChild(m_program, node, [&](NodeRef child) { count += nodeCount(child); });
+    return count;
 }
 
 void Parser::ASTtoString(std::ostream& os)
@@ -31,133 +404,384 @@ void Parser::ASTtoString(std::ostream& os)
     m_program.toString(os, /* default indentation level */ 0);
 }
 
-bool Parser::operator_(std::string* s)
+std::vector<std::uint8_t> Parser::generateBytecode()
+{
+    return Compiler(m_program).compile().write();
+}
+
+void Parser::setPackrat(bool enabled)
+{
+    m_packrat = enabled;
+    m_packratHits = 0;
+    clearPackratCache();
+}
+
+void Parser::clearPackratCache()
+{
+    m_packratCache.clear();
+
+    if (m_packrat)
+        m_packratCache.resize(m_tokens.size() * static_cast<std::size_t>(PackratRule::Count));
+}
+
+std::size_t Parser::getPackratHits()
+{
+    return m_packratHits;
+}
+
+void Parser::setThreads(std::size_t count)
+{
+    m_threads = count;
+}
+
+void Parser::setErrorMode(ErrorMode mode)
+{
+    m_errorMode = mode;
+}
+
+const std::vector<Diagnostic>& Parser::getDiagnostics()
 {
-    if (accept(IsNot(IsChar(' ')), s))
+    return m_diagnostics;
+}
+
+void Parser::setFileId(std::uint32_t id)
+{
+    if (id > Span::MaxFile)
+        throw std::out_of_range("File identifier " + std::to_string(id) + " doesn't fit in a span");
+    m_fileId = id;
+}
+
+Program& Parser::getProgram()
+{
+    return m_program;
+}
+
+Position Parser::getPosition(const Span& span)
+{
+    return m_lines.position(span.offset);
+}
+
+MaybeNodeRef Parser::packrat(PackratRule rule, MaybeNodeRef (Parser::*parser)())
+{
+    if (!m_packrat)
+        return (this->*parser)();
+
+    PackratEntry& entry = m_packratCache[m_pos * static_cast<std::size_t>(PackratRule::Count) + static_cast<std::size_t>(rule)];
+    if (entry.epoch == m_packratEpoch)
     {
-        while (accept(IsNot(IsChar(' ')), s));
-        return true;
+        ++m_packratHits;
+        m_pos = entry.end;
+        return entry.result;
     }
-    return false;
+
+    // the result of a rule stopped by an error isn't cached, recover mode could come back here
+    MaybeNodeRef result = (this->*parser)();
+    if (!m_failed)
+    {
+        entry.epoch = m_packratEpoch;
+        entry.result = result;
+        entry.end = m_pos;
+    }
+
+    return result;
 }
 
-bool Parser::inlineSpace(std::string* s)
+MaybeNodeRef Parser::error(const std::string& error, const std::string exp)
 {
-    if (accept(IsInlineSpace))
+    const Token& tok = current();
+
+    // the lexer couldn't read this token, it is the real error
+    std::string what = error;
+    std::string expected = exp;
+    if (tok.type == TokenType::Invalid)
     {
-        if (s != nullptr)
-            s->push_back(' ');
-        // loop while there are still ' ' to consume
-        while (accept(IsInlineSpace));
-        return true;
+        what = m_code[tok.offset] == '"' ? "Unterminated string" : "Unexpected character";
+        expected = "";
+    }
+
+    // tokens only know their offset, compute the position from it
+    Position pos = m_lines.position(tok.offset);
+
+    int sym = tok.offset < m_code.size() ? m_code[tok.offset] : EOF;
+    if (m_errorMode == ErrorMode::Throw)
+    {
+        // the parsing can't go on after the exception
+        m_failed = true;
+        throw ParseError(what, pos.row, pos.col, expected, sym);
     }
-    return false;
+
+    // only the first error is meaningful, the next ones are caused by it
+    if (!m_failed)
+    {
+        m_failed = true;
+        m_diagnostics.push_back(Diagnostic { what, pos.row, pos.col, expected, sym });
+    }
+    return {};
 }
 
-bool Parser::endOfLine(std::string* s)
+const Token& Parser::current()
 {
-    if ((accept(IsChar('\r')) || true) && accept(IsChar('\n')))
+    return m_tokens[m_pos];
+}
+
+std::string_view Parser::text(const Token& token)
+{
+    return m_code.substr(token.offset, token.length);
+}
+
+bool Parser::isEOF()
+{
+    return current().type == TokenType::EndOfFile;
+}
+
+int Parser::binaryPrecedence(const Token& token)
+{
+    if (token.type != TokenType::Operator)
+        return 0;
+
+    std::string_view name = text(token);
+    for (const BinaryOperator& op : g_binaryOperators)
     {
-        if (s != nullptr)
-            s->push_back('\n');
-        while ((accept(IsChar('\r')) || true) && accept(IsChar('\n')));
-        return true;
+        if (op.name == name)
+            return op.precedence;
     }
-    return false;
+    return 0;
+}
+
+bool Parser::isUnaryOperator(const Token& token)
+{
+    if (token.type != TokenType::Operator)
+        return false;
+
+    std::string_view name = text(token);
+    return name == "-" || name == "~" || name == "not";
 }
 
-bool Parser::comment(std::string* s)
+bool Parser::accept(TokenType type, std::string* s)
 {
-    inlineSpace();
+    // return false if the current token isn't of the wanted type
+    if (current().type != type)
+        return false;
+    // otherwise, add it to the string and go to the next token
+    if (s != nullptr)
+        s->append(text(current()));
+    // never go past the EndOfFile token
+    if (!isEOF())
+        ++m_pos;
+    return true;
+}
 
-    // inline comment starts with '//'
-    if (accept(IsChar('/')) && accept(IsChar('/')))
+bool Parser::accept(TokenType type, Symbol* symbol)
+{
+    if (current().type != type)
+        return false;
+    // only the symbol is kept, the name isn't copied if it is already known
+    *symbol = m_program.symbols.intern(text(current()));
+    if (!isEOF())
+        ++m_pos;
+    return true;
+}
+
+bool Parser::except(TokenType type, std::string* s)
+{
+    // report an error if the current token isn't of the wanted type
+    if (!accept(type, s))
     {
-        while (accept(IsNot(IsChar('\n')), s));
-        return true;
+        error("Unexpected token", std::string(text(current())));
+        return false;
     }
-    return false;
+    return true;
 }
 
-bool Parser::endOfLineAndOrComment(std::string* s)
+bool Parser::backtrack(std::size_t position)
 {
-    comment(s);
-    return endOfLine(s);
+    if (m_failed)
+        return false;
+
+    m_pos = position;
+    return true;
+}
+
+bool Parser::recover(std::size_t start, bool classBody)
+{
+    if (m_errorMode != ErrorMode::Recover || !m_failed)
+        return false;
+
+    // skip the whole block, the nested ones included (true for a class)
+    if (isBlockStart(start, classBody))
+    {
+        std::vector<bool> blocks;
+        for (m_pos = start; !isEOF(); ++m_pos)
+        {
+            if (isBlockStart(m_pos, blocks.empty() ? classBody : blocks.back()))
+                blocks.push_back(current().type == TokenType::Cls);
+            else if (current().type == TokenType::End)
+            {
+                blocks.pop_back();
+                if (blocks.empty())
+                {
+                    ++m_pos;
+                    break;
+                }
+            }
+        }
+    }
+
+    // then the rest of the line
+    while (!isEOF() && !accept(TokenType::NewLine))
+        ++m_pos;
+
+    if (isEOF())
+        return false;
+
+    m_failed = false;
+    return true;
 }
 
-MaybeNodePtr Parser::parseInstruction()
+bool Parser::isBlockStart(std::size_t position, bool classBody)
 {
-    // save current position in buffer to be able to go back if needed
-    auto current = getCount();
+    // the keywords only open a block at the beginning of a line
+    if (position > 0 && m_tokens[position - 1].type != TokenType::NewLine)
+        return false;
 
-    // parsing single line comments as instructions
-    while (comment())
-        endOfLine();
+    // elsewhere, 'new' starts an instanciation
+    TokenType type = m_tokens[position].type;
+    return type == TokenType::Fun || type == TokenType::Cls || type == TokenType::If || (type == TokenType::New && classBody);
+}
 
-    // x:type, x:type=value
-    if (auto inst = parseDeclaration())
-        return inst;
-    else
-        back(getCount() - current + 1);
-    
-    // cst x:type=value
-    if (auto inst = parseConstDef())
-        return inst;
-    else
-        back(getCount() - current + 1);
-    
-    // x = value
-    if (auto inst = parseAssignment())
-        return inst;
-    else
-        back(getCount() - current + 1);
-
-	// if condition then ... [elif condition then ...]+ [else ...] end
-	if (auto inst = parseIf())
-		return inst;
-	else
-		back(getCount() - current + 1);
-    
-    // fun name(arg:type, ...) -> type {body} end
-    if (auto inst = parseFunction())
-        return inst;
-    else
-        back(getCount() - current + 1);
-    
-    // cls Name ... end
-    if (auto inst = parseClass())
-        return inst;
-    else
-        back(getCount() - current + 1);
-    
-    // new Name() ... end
-    if (auto inst = parseConstructor())
-        return inst;
-    else
-        back(getCount() - current + 1);
-    
-    // ret value
-    if (auto inst = parseRet())
-        return inst;
-    else
-        back(getCount() - current + 1);
-    
-    // token 'end' closing a block
-    if (auto inst = parseEnd())
-        return inst;
-    else
-        back(getCount() - current + 1);
+Span Parser::spanFrom(std::uint32_t begin, std::size_t end)
+{
+    // the line end terminating an instruction isn't part of it
+    std::size_t last = end;
+    while (last > 0 && m_tokens[last - 1].type == TokenType::NewLine)
+        --last;
+
+    std::uint32_t endOffset = begin;
+    if (last > 0)
+        endOffset = std::max(endOffset, m_tokens[last - 1].offset + m_tokens[last - 1].length);
+    return Span(m_fileId, begin, endOffset - begin);
+}
+
+bool Parser::endOfLine()
+{
+    // comments were already removed by the lexer
+    return accept(TokenType::NewLine) || isEOF();
+}
+
+MaybeNodeRef Parser::parseInstructionOrRecover(bool classBody)
+{
+    while (true)
+    {
+        // skip the empty lines and comments
+        while (accept(TokenType::NewLine));
+        // a block without its 'end', the caller reports it
+        if (isEOF())
+            return {};
+
+        std::size_t start = m_pos;
+        MaybeNodeRef inst = parseInstruction();
+        if (!m_failed || !recover(start, classBody))
+            return inst;
+
+        // keep the keywords closing a block, otherwise the whole block would be lost
+        const Token& keyword = m_tokens[start];
+        NodeRef ref;
+        if (keyword.type == TokenType::End)
+            ref = m_program.make<End>();
+        else if (keyword.type == TokenType::Else)
+            ref = m_program.make<Else>();
+        else
+            continue;
+        m_program.get(ref).span = Span(m_fileId, keyword.offset, keyword.length);
+        return ref;
+    }
+}
+
+MaybeNodeRef Parser::parseInstruction()
+{
+    // skip the empty lines and comments
+    while (accept(TokenType::NewLine));
+
+    // save current position in the tokens to be able to go back if needed
+    auto current = m_pos;
+
+    // the first token is enough to know which parser to use
+    switch (m_tokens[m_pos].type)
+    {
+        // cst x:type=value
+        case TokenType::Cst:
+            return parseConstDef();
+
+        // if condition then ... [elif condition then ...]+ [else ...] end
+        case TokenType::If:
+            return parseIf();
+
+        // fun name(arg:type, ...) -> type {body} end
+        case TokenType::Fun:
+            return parseFunction();
+
+        // cls Name ... end
+        case TokenType::Cls:
+            return parseClass();
+
+        // new Name() ... end
+        case TokenType::New:
+            if (auto inst = parseConstructor())
+                return inst;
+            else if (!backtrack(current))
+                return {};
+            break;
+
+        // ret value
+        case TokenType::Ret:
+            return parseRet();
+
+        // token 'end' closing a block
+        case TokenType::End:
+            return parseEnd();
+
+        // tokens 'elif' and 'else' splitting an if-clause
+        case TokenType::Elif:
+            return parseElif();
+
+        case TokenType::Else:
+            return parseElse();
+
+        // for a name, the second token tells us what to do
+        case TokenType::Name:
+            switch (m_tokens[m_pos + 1].type)
+            {
+                // x:type, x:type=value
+                case TokenType::Colon:
+                    return parseDeclaration();
+
+                // x = value
+                case TokenType::Assign:
+                case TokenType::AssignOp:
+                    return parseAssignment();
+
+                default:
+                    break;
+            }
+            break;
+
+        default:
+            break;
+    }
 
     // function/method calls
-	if (auto inst = parseExp())
-		return inst;
-    else
-        back(getCount() - current + 1);
-    
+    if (auto inst = parseExp())
+    {
+        if (!endOfLine())
+            return error("Expected end of line after expression", "");
+        return inst;
+    }
+
+    backtrack(current);
     return {};
 }
 
-MaybeNodePtr Parser::parseDeclaration()
+MaybeNodeRef Parser::parseDeclaration()
 {
     /*
         Trying to parse those kind of expression:
@@ -165,51 +789,44 @@ MaybeNodePtr Parser::parseDeclaration()
         x : type = value
     */
 
-    // eat the trailing white space
-    inlineSpace();
-
-    std::string varname = "";
-    if (!name(&varname))
+    std::uint32_t begin = current().offset;
+    Symbol varname = 0;
+    if (!accept(TokenType::Name, &varname))
         return {};
-    
-    inlineSpace();
+
     // : after varname and before type is mandatory
-    if (!accept(IsChar(':')))
+    if (!accept(TokenType::Colon))
         return {};
-    inlineSpace();
 
-    std::string type = "";
-    if (!name(&type))
-        error("Expected type name for declaration", type);
-    
-    inlineSpace();
+    Symbol type = 0;
+    if (!accept(TokenType::Name, &type))
+        return error("Expected type name for declaration", "");
+
     // checking for value (optional)
-    if (!accept(IsChar('=')))
+    if (!accept(TokenType::Assign))
     {
-        auto temp = std::make_shared<Declaration>(varname, type);
-        if (!endOfLineAndOrComment())
-            error("Expected end of line after declaration", "");
+        auto temp = make<Declaration>(begin, varname, type);
+        if (!endOfLine())
+            return error("Expected end of line after declaration", "");
         return temp;
     }
     else
     {
-        inlineSpace();
-
         if (auto exp = parseExp())
         {
-            auto temp = std::make_shared<Definition>(varname, type, exp.value());
-            if (!endOfLineAndOrComment())
-                error("Expected end of line after definition", "");
+            auto temp = make<Definition>(begin, varname, type, exp.value());
+            if (!endOfLine())
+                return error("Expected end of line after definition", "");
             return temp;
         }
         else
-            error("Expected a valid expression for definition", "");
+            return error("Expected a valid expression for definition", "");
     }
 
     return {};
 }
 
-MaybeNodePtr Parser::parseConstDef()
+MaybeNodeRef Parser::parseConstDef()
 {
     /*
         Trying to parse constant definitions:
@@ -217,50 +834,41 @@ MaybeNodePtr Parser::parseConstDef()
         cst var : type = value
     */
 
-    // eat the trailing white space
-    inlineSpace();
-
+    std::uint32_t begin = current().offset;
     // checking if 'cst' is present
-    std::string const_qualifier = "";
-    if (!name(&const_qualifier))
-        return {};
-    if (const_qualifier != "cst")
+    if (!accept(TokenType::Cst))
         return {};
-    
-    inlineSpace();
-
-    std::string varname = "";
-    if (!name(&varname))
-        error("Expected constant name", varname);
-    
-    inlineSpace();
+
+    Symbol varname = 0;
+    if (!accept(TokenType::Name, &varname))
+        return error("Expected constant name", "");
+
     // : after varname and before type is mandatory
-    except(IsChar(':'));
-    inlineSpace();
-
-    std::string type = "";
-    if (!name(&type))
-        error("Expected type name for constant definition", type);
-    
-    inlineSpace();
+    if (!except(TokenType::Colon))
+        return {};
+
+    Symbol type = 0;
+    if (!accept(TokenType::Name, &type))
+        return error("Expected type name for constant definition", "");
+
     // checking for value
-    except(IsChar('='));
-    inlineSpace();
-    
+    if (!except(TokenType::Assign))
+        return {};
+
     if (auto exp = parseExp())
     {
-        auto temp = std::make_shared<ConstDef>(varname, type, exp.value());
-        if (!endOfLineAndOrComment())
-            error("Expected end of line after constant definition", "");
+        auto temp = make<ConstDef>(begin, varname, type, exp.value());
+        if (!endOfLine())
+            return error("Expected end of line after constant definition", "");
         return temp;
     }
     else
-        error("Expected a valid expression as a value for constant definition", "");
-    
+        return error("Expected a valid expression as a value for constant definition", "");
+
     return {};
 }
 
-MaybeNodePtr Parser::parseAssignment()
+MaybeNodeRef Parser::parseAssignment()
 {
     /*
         Trying to parse assignment, such as:
@@ -271,42 +879,35 @@ MaybeNodePtr Parser::parseAssignment()
         etc.
     */
 
-    // eat the trailing white space
-    inlineSpace();
-
-    std::string varname = "";
-    if (!name(&varname))
+    std::uint32_t begin = current().offset;
+    Symbol varname = 0;
+    if (!accept(TokenType::Name, &varname))
         return {};
-    
-    inlineSpace();
-    
+
     // we can have an operator before the '=' sign
-    std::string op = "";
-    if (!operator_(&op))
-        return {};
-    if (op != "=" && !isOperator(op))  // what is it? we don't want it
+    Symbol op = 0;
+    if (!accept(TokenType::Assign, &op) && !accept(TokenType::AssignOp, &op))
         return {};
-    
-    inlineSpace();
-    
+
     if (auto exp = parseExp())
     {
-        auto temp = std::make_shared<Assignment>(
-            varname,
-            exp.value(),
-            isOperator(op) ? op : "="
-        );
-        if (!endOfLineAndOrComment())
-            error("Expected end of line after assignment", "");
+        auto temp = make<Assignment>(begin, varname, exp.value(), op);
+        if (!endOfLine())
+            return error("Expected end of line after assignment", "");
         return temp;
     }
     else
-        error("Expected a valid expression as a value to assign to variable", "");
-    
+        return error("Expected a valid expression as a value to assign to variable", "");
+
     return {};
 }
 
-MaybeNodePtr Parser::parseExp()
+MaybeNodeRef Parser::parseExp()
+{
+    return packrat(PackratRule::Exp, &Parser::parseExpUncached);
+}
+
+MaybeNodeRef Parser::parseExpUncached()
 {
     /*
         Trying to parse right hand side values, such as:
@@ -319,162 +920,173 @@ MaybeNodePtr Parser::parseExp()
         - operations (comparisons, additions...)
     */
 
-    auto current = getCount();
+    auto current = m_pos;
 
-	// parsing class instanciation before operations otherwise they are seen as operation member
-	if (auto exp = parseClassInstanciation())  // new Stuff("hello", 12)
-		return exp;
-	else
-		back(getCount() - current + 1);
+    // parsing class instanciation before operations otherwise they are seen as operation member
+    if (auto exp = parseClassInstanciation())  // new Stuff("hello", 12)
+        return exp;
+    else if (!backtrack(current))
+        return {};
 
     // parsing operations before anything else because it must use the other parsers
     if (auto exp = parseOperation())
         return exp;
-    else
-        back(getCount() - current + 1);
+    else if (!backtrack(current))
+        return {};
 
     if (auto exp = parseSingleExp())
         return exp;
-    else
-        back(getCount() - current + 1);
+    else if (!backtrack(current))
+        return {};
 
     return {};
 }
 
-MaybeNodePtr Parser::parseOperation()
+MaybeNodeRef Parser::parseOperation()
+{
+    return packrat(PackratRule::Operation, &Parser::parseOperationUncached);
+}
+
+MaybeNodeRef Parser::parseOperationUncached()
 {
     /*
         Trying to parse operations such as
         1 + 2
         1 / (2 + 3)
+        not a == -b
 
-        Get current token: it must be a '('
-        If it's not => quit
-        Otherwise, get token[n+1], it must an expression
-        Token[n+2] must be an operator:
-            +, -, *, /
-            <<, >>, ~
-            and, or, not
+        Precedence climbing, from the loosest to the tightest:
+            or
+            and
+            not (prefix)
             ==, !=, <, <=, >, >=
-        Parsing end when:
-            - the expression couldn't be parsed (VarUse being a keyword can break the whole thing)
-            - there was no error and we found the matching ')'
-        
-        TODO This parser should also do a "shunting yard"
+            <<, >>
+            +, -
+            *, /
+            -, ~ (prefix)
     */
-    
-    // parse expressions
-    NodePtrList operations;
+
+    // without any operator, it is only a single expression
+    std::uint32_t begin = current().offset;
+    bool prefixed = isUnaryOperator(current());
+
+    MaybeNodeRef lhs = parseUnary();
+    if (!lhs)
+        return {};
+    if (!prefixed && binaryPrecedence(current()) == 0)
+        return {};
+
+    return parseBinary(begin, lhs.value(), 1);
+}
+
+MaybeNodeRef Parser::parseUnary()
+{
+    if (!isUnaryOperator(current()))
+        return parseSingleExp();
+
+    std::uint32_t begin = current().offset;
+    bool isNot = text(current()) == "not";
+    Symbol op = 0;
+    accept(TokenType::Operator, &op);
+
+    std::uint32_t operandBegin = current().offset;
+    MaybeNodeRef operand = parseUnary();
+    if (!operand)
+        return {};
+
+    if (isNot)
+    {
+        operand = parseBinary(operandBegin, operand.value(), g_notOperandPrecedence);
+        if (!operand)
+            return {};
+    }
+
+    return make<UnaryOp>(begin, op, operand.value());
+}
+
+MaybeNodeRef Parser::parseBinary(std::uint32_t begin, NodeRef lhs, int minPrecedence)
+{
     while (true)
     {
-        inlineSpace();
+        int precedence = binaryPrecedence(current());
+        if (precedence == 0 || precedence < minPrecedence)
+            return lhs;
 
-        // getting prefix operator
-        auto current = getCount();
-        if (accept(IsMinus) && accept(IsSpace))
-            operations.push_back(std::make_shared<Operator>("-"));
-        else
-            back(getCount() - current + 1);
-        
-        if (accept(IsChar('~')))
-            operations.push_back(std::make_shared<Operator>("~"));
-        else
-            back(getCount() - current + 1);
-        
-        std::string token = "";
-        if (name(&token) && token == "not")
-            operations.push_back(std::make_shared<Operator>("not"));
-        else
-            back(getCount() - current + 1);
-        
-        inlineSpace();
-        
-        // get operand
-        current = getCount();
-        if (auto exp = parseSingleExp())
-            operations.push_back(exp.value());
-        else
-        {
-            std::cout << "???" << std::endl;
-            back(getCount() - current + 1);
-            break;
-        }
-        
-        inlineSpace();
+        Symbol op = 0;
+        accept(TokenType::Operator, &op);
 
-        current = getCount();
-        std::string op = "";
-        if (!operator_(&op))
+        std::uint32_t rhsBegin = current().offset;
+        MaybeNodeRef rhs = parseUnary();
+        if (!rhs)
             return {};
-        if (!isOperator(op))
+
+        // the operators binding tighter take the right hand side first
+        while (binaryPrecedence(current()) > precedence)
         {
-            if (operations.size() < 2)
+            rhs = parseBinary(rhsBegin, rhs.value(), precedence + 1);
+            if (!rhs)
                 return {};
-            
-            back(getCount() - current + 1);
-            break;
         }
-        
-        operations.push_back(std::make_shared<Operator>(op));
-    }
 
-    if (operations.size() == 0)
-        return {};
+        lhs = make<BinaryOp>(begin, op, lhs, rhs.value());
+    }
+}
 
-    return std::make_shared<OperationsList>(operations);
+MaybeNodeRef Parser::parseSingleExp()
+{
+    return packrat(PackratRule::SingleExp, &Parser::parseSingleExpUncached);
 }
 
-MaybeNodePtr Parser::parseSingleExp()
+MaybeNodeRef Parser::parseSingleExpUncached()
 {
-    auto current = getCount();
+    auto current = m_pos;
 
     if (auto exp = parseOperationBlock())  // (1 + 2 - 4)
         return exp;
-    else
-        back(getCount() - current + 1);
+    else if (!backtrack(current))
+        return {};
 
-    // parsing float before integer because float requires a '.'
+    // the lexer already told integers and floats apart, the order doesn't matter
     if (auto exp = parseFloat())  // 1.5
         return exp;
-    else
-        back(getCount() - current + 1);
+    else if (!backtrack(current))
+        return {};
 
     if (auto exp = parseInt())  // 42
         return exp;
-    else
-        back(getCount() - current + 1);
+    else if (!backtrack(current))
+        return {};
 
     if (auto exp = parseString())  // "hello world"
         return exp;
-    else
-        back(getCount() - current + 1);
+    else if (!backtrack(current))
+        return {};
 
     if (auto exp = parseBool())  // true
         return exp;
-    else
-        back(getCount() - current + 1);
-    
+    else if (!backtrack(current))
+        return {};
+
     if (auto exp = parseFunctionCall())  // foo(42, -6.66)
         return exp;
-    else
-        back(getCount() - current + 1);
-    
+    else if (!backtrack(current))
+        return {};
+
     if (auto exp = parseMethodCall())  // bar.foo(42, -6.66)
         return exp;
-    else
-        back(getCount() - current + 1);
-    
+    else if (!backtrack(current))
+        return {};
+
     // must the last one, otherwise it would try to parse function/method calls
     if (auto exp = parseVarUse())  // varname
         return exp;
-    else
-        back(getCount() - current + 1);
-    
-    error("Couldn't parse single expression", "");
-    return {};  // to avoid warnings
+    else if (!backtrack(current))
+        return {};
+
+    return error("Couldn't parse single expression", "");
 }
 
-MaybeNodePtr Parser::parseOperationBlock()
+MaybeNodeRef Parser::parseOperationBlock()
 {
     /*
         Trying to parse operations, but inside parens, such as:
@@ -482,66 +1094,71 @@ MaybeNodePtr Parser::parseOperationBlock()
         (1 + 2 - 5)
     */
 
-    if (accept(IsChar('(')))
+    if (accept(TokenType::LParen))
     {
-        MaybeNodePtr op = parseOperation();
-        if (op && accept(IsChar(')')))
+        MaybeNodeRef op = parseOperation();
+        if (op && accept(TokenType::RParen))
             return op;
     }
 
     return {};
 }
 
-MaybeNodePtr Parser::parseInt()
+MaybeNodeRef Parser::parseInt()
 {
-    std::string n = "";
-    if (signedNumber(&n))
-        return std::make_shared<Integer>(std::stoi(n));
-    return {};
+    if (current().type != TokenType::Integer)
+        return {};
+
+    // the lexer already checked the syntax, only the range can be wrong
+    std::uint32_t begin = current().offset;
+    std::int64_t value = 0;
+    if (!toInteger(text(current()), value))
+        return error("Integer literal doesn't fit in 64 bits", std::string(text(current())));
+
+    accept(TokenType::Integer);
+    return make<Integer>(begin, value);
 }
 
-MaybeNodePtr Parser::parseFloat()
+MaybeNodeRef Parser::parseFloat()
 {
-    std::string f = "";
-    if (signedNumber(&f) && accept(IsChar('.'), &f) && number(&f))
-        return std::make_shared<Float>(std::stof(f));
-    return {};
+    if (current().type != TokenType::Float)
+        return {};
+
+    std::uint32_t begin = current().offset;
+    float value = 0.f;
+    if (!toFloat(text(current()), value))
+        return error("Float literal out of range", std::string(text(current())));
+
+    accept(TokenType::Float);
+    return make<Float>(begin, value);
 }
 
-MaybeNodePtr Parser::parseString()
+MaybeNodeRef Parser::parseString()
 {
-    std::string s = "";
-
-    if (accept(IsChar('"'), &s))
-    {
-        while (accept(IsNot(IsChar('"')), &s));
-        except(IsChar('"'), &s);
+    if (current().type != TokenType::String)
+        return {};
 
-        // remove " at the beginning and end
-        s.erase(0, 1);
-        s.erase(s.end() - 1);
+    std::uint32_t begin = current().offset;
+    // remove " at the beginning and end
+    std::string_view s = text(current());
+    std::string_view value = m_program.text(s.substr(1, s.size() - 2));
+    accept(TokenType::String);
 
-        return std::make_shared<String>(s);
-    }
-    return {};
+    return make<String>(begin, value);
 }
 
-MaybeNodePtr Parser::parseBool()
+MaybeNodeRef Parser::parseBool()
 {
-    std::string s = "";
+    std::uint32_t begin = current().offset;
+    if (accept(TokenType::False))
+        return make<Bool>(begin, false);
+    else if (accept(TokenType::True))
+        return make<Bool>(begin, true);
 
-    if (!name(&s))
-        return {};
-    
-    if (s == "false")
-        return std::make_shared<Bool>(false);
-    else if (s == "true")
-        return std::make_shared<Bool>(true);
-    
     return {};
 }
 
-MaybeNodePtr Parser::parseClassInstanciation()
+MaybeNodeRef Parser::parseClassInstanciation()
 {
     /*
         Trying to parse class instanciation:
@@ -549,55 +1166,42 @@ MaybeNodePtr Parser::parseClassInstanciation()
         new Stuff(5, 12)
     */
 
-    inlineSpace();
-
-    std::string keyword = "";
-    if (!name(&keyword))
+    std::uint32_t begin = current().offset;
+    if (!accept(TokenType::New))
         return {};
-    if (keyword != "new")
-        return {};
-    
-    inlineSpace();
 
     // getting the name of the class
-    std::string clsname = "";
-    if (!name(&clsname))
+    Symbol clsname = 0;
+    if (!accept(TokenType::Name, &clsname))
         return {};
-    
-    inlineSpace();
-    
+
     // getting the arguments
-    NodePtrList arguments;
-    if (accept(IsChar('(')))
+    std::vector<NodeRef> arguments;
+    if (accept(TokenType::LParen))
     {
         while (true)
         {
-            // eat the trailing white space
-            inlineSpace();
-
             // check if end of arguments
-            if (accept(IsChar(')')))
+            if (accept(TokenType::RParen))
                 break;
 
             // find argument
             if (auto inst = parseExp())
                 arguments.push_back(inst.value());
             else
-                error("Expected a valid expression as class constructor argument", "");
-
-            inlineSpace();
+                return error("Expected a valid expression as class constructor argument", "");
 
             // check for ',' -> other arguments
-            if (accept(IsChar(',')))
+            if (accept(TokenType::Comma))
                 continue;
         }
 
-        return std::make_shared<ClassInstanciation>(clsname, arguments);
+        return make<ClassInstanciation>(begin, clsname, m_program.list(arguments));
     }
     return {};
 }
 
-MaybeNodePtr Parser::parseFunctionCall()
+MaybeNodeRef Parser::parseFunctionCall()
 {
     /*
         Trying to parse stuff like this:
@@ -607,47 +1211,39 @@ MaybeNodePtr Parser::parseFunctionCall()
         doStuff()
     */
 
-    inlineSpace();
-
+    std::uint32_t begin = current().offset;
     // getting the name of the function
-    std::string funcname = "";
-    if (!name(&funcname))
+    Symbol funcname = 0;
+    if (!accept(TokenType::Name, &funcname))
         return {};
-    
-    inlineSpace();
-    
+
     // getting the arguments
-    NodePtrList arguments;
-    if (accept(IsChar('(')))
+    std::vector<NodeRef> arguments;
+    if (accept(TokenType::LParen))
     {
         while (true)
         {
-            // eat the trailing white space
-            inlineSpace();
-
             // check if end of arguments
-            if (accept(IsChar(')')))
+            if (accept(TokenType::RParen))
                 break;
 
             // find argument
             if (auto inst = parseExp())
                 arguments.push_back(inst.value());
             else
-                error("Expected a valid expression as function argument", "");
-
-            inlineSpace();
+                return error("Expected a valid expression as function argument", "");
 
             // check for ',' -> other arguments
-            if (accept(IsChar(',')))
+            if (accept(TokenType::Comma))
                 continue;
         }
 
-        return std::make_shared<FunctionCall>(funcname, arguments);
+        return make<FunctionCall>(begin, funcname, m_program.list(arguments));
     }
     return {};
 }
 
-MaybeNodePtr Parser::parseMethodCall()
+MaybeNodeRef Parser::parseMethodCall()
 {
     /*
         Trying to parse stuff like this:
@@ -657,55 +1253,47 @@ MaybeNodePtr Parser::parseMethodCall()
         you.doStuff()
     */
 
-    inlineSpace();
-
+    std::uint32_t begin = current().offset;
     // getting the name of the object
-    std::string objectname = "";
-    if (!name(&objectname))
+    Symbol objectname = 0;
+    if (!accept(TokenType::Name, &objectname))
         return {};
-    
-    if (!accept(IsChar('.')))  // '.' between object name and method name
+
+    if (!accept(TokenType::Dot))  // '.' between object name and method name
         return {};
-    
+
     // getting function name
-    std::string funcname = "";
-    if (!name(&funcname))
-        error("Expecting a method name after '" + objectname + ".'", funcname);
-    
-    inlineSpace();
-    
+    Symbol funcname = 0;
+    if (!accept(TokenType::Name, &funcname))
+        return error("Expecting a method name after '" + std::string(m_program.symbols.name(objectname)) + ".'", "");
+
     // getting the arguments
-    NodePtrList arguments;
-    if (accept(IsChar('(')))
+    std::vector<NodeRef> arguments;
+    if (accept(TokenType::LParen))
     {
         while (true)
         {
-            // eat the trailing white space
-            inlineSpace();
-
             // check if end of arguments
-            if (accept(IsChar(')')))
+            if (accept(TokenType::RParen))
                 break;
 
             // find argument
             if (auto inst = parseExp())
                 arguments.push_back(inst.value());
             else
-                error("Expected a valid expression as method argument", "");
-
-            inlineSpace();
+                return error("Expected a valid expression as method argument", "");
 
             // check for ',' -> other arguments
-            if (accept(IsChar(',')))
+            if (accept(TokenType::Comma))
                 continue;
         }
 
-        return std::make_shared<MethodCall>(objectname, funcname, arguments);
+        return make<MethodCall>(begin, objectname, funcname, m_program.list(arguments));
     }
     return {};
 }
 
-MaybeNodePtr Parser::parseVarUse()
+MaybeNodeRef Parser::parseVarUse()
 {
     /*
         Trying to parse things such as
@@ -714,38 +1302,32 @@ MaybeNodePtr Parser::parseVarUse()
         ~~~~~~~~~^^^^^^^
     */
 
-    std::string varname = "";
-    if (!name(&varname))
+    std::uint32_t begin = current().offset;
+    // keywords have their own token type, they can't be used as a variable
+    Symbol varname = 0;
+    if (!accept(TokenType::Name, &varname))
         return {};
-    
-    // checking if varname is a keyword
-    if (isKeyword(varname))
-        return {};
-    
-    return std::make_shared<VarUse>(varname);
+
+    return make<VarUse>(begin, varname);
 }
 
-MaybeNodePtr Parser::parseEnd()
+MaybeNodeRef Parser::parseEnd()
 {
     /*
         Trying to parse 'end' tokens
     */
 
-    inlineSpace();
-
-    std::string keyword = "";
-    if (!name(&keyword))
+    std::uint32_t begin = current().offset;
+    if (!accept(TokenType::End))
         return {};
-    if (keyword != "end")
-        return {};
-    
-    auto temp = std::make_shared<End>();
-    if (!endOfLineAndOrComment())
-        error("Expected end of line after keyword end", "");
+
+    auto temp = make<End>(begin);
+    if (!endOfLine())
+        return error("Expected end of line after keyword end", "");
     return temp;
 }
 
-MaybeNodePtr Parser::parseFunction()
+MaybeNodeRef Parser::parseFunction()
 {
     /*
         Trying to parse functions:
@@ -757,99 +1339,83 @@ MaybeNodePtr Parser::parseFunction()
         NB: code... can (should) include a 'ret value'
     */
 
-    // eat trailing white spaces
-    inlineSpace();
-
+    std::uint32_t begin = current().offset;
     // checking for 'fun'
-    std::string keyword = "";
-    if (!name(&keyword))
-        return {};
-    if (keyword != "fun")
+    if (!accept(TokenType::Fun))
         return {};
 
-    inlineSpace();
-
     // getting name
-    std::string funcname = "";
-    if (!name(&funcname))
-        error("Expected function name", funcname);
-    
-    inlineSpace();
+    Symbol funcname = 0;
+    if (!accept(TokenType::Name, &funcname))
+        return error("Expected function name", "");
 
     // getting arguments (enclosed in ())
-    NodePtrList arguments;
-    if (except(IsChar('(')))
+    std::vector<NodeRef> arguments;
+    if (!except(TokenType::LParen))
+        return {};
+
+    while (true)
     {
-        while (true)
-        {
-            // eat the trailing white space
-            inlineSpace();
+        // check if end of arguments
+        if (accept(TokenType::RParen))
+            break;
 
-            // check if end of arguments
-            if (accept(IsChar(')')))
-                break;
+        std::uint32_t argBegin = current().offset;
+        Symbol varname = 0;
+        if (!accept(TokenType::Name, &varname))
+            break;  // we don't have arguments
 
-            std::string varname = "";
-            if (!name(&varname))
-                break;  // we don't have arguments
-            
-            inlineSpace();
-            // : after varname and before type is mandatory
-            if (!except(IsChar(':')))
-                error("Expected ':' after argument name and before type name", "");
-            inlineSpace();
-
-            std::string type = "";
-            if (!name(&type))
-                error("Expected type name for argument in function definition", type);
-            
-            inlineSpace();
-
-            // register argument
-            arguments.push_back(
-                std::make_shared<Declaration>(varname, type)
-            );
+        // : after varname and before type is mandatory
+        if (!accept(TokenType::Colon))
+            return error("Expected ':' after argument name and before type name", "");
 
-            // check for ',' -> other arguments
-            if (accept(IsChar(',')))
-                continue;
-        }
+        Symbol type = 0;
+        if (!accept(TokenType::Name, &type))
+            return error("Expected type name for argument in function definition", "");
+
+        // register argument
+        arguments.push_back(
+            make<Declaration>(argBegin, varname, type)
+        );
+
+        // check for ',' -> other arguments
+        if (accept(TokenType::Comma))
+            continue;
     }
 
-    inlineSpace();
     // need the full '->'
-    except(IsChar('-')); except(IsChar('>'));
-    inlineSpace();
+    if (!except(TokenType::Arrow))
+        return {};
 
     // getting function type
-    std::string type = "";
-    if (!name(&type))
-        error("Expected return type for function definition", type);
-    if (!endOfLineAndOrComment())
-        error("Expected end of line after function return type", "");;
-    
+    Symbol type = 0;
+    if (!accept(TokenType::Name, &type))
+        return error("Expected return type for function definition", "");
+    if (!endOfLine())
+        return error("Expected end of line after function return type", "");
+
     // getting the body
-    NodePtrList body;
+    std::vector<NodeRef> body;
     while (true)
     {
-        MaybeNodePtr inst = parseInstruction();
+        MaybeNodeRef inst = parseInstructionOrRecover();
 
         // after getting the instruction, check if it's valid
         if (inst)
         {
             // if we found a 'end' token, stop
-            if (inst.value()->nodename == "end")
+            if (m_program.get(inst.value()).kind == NodeKind::End)
                 break;
             body.push_back(inst.value());
         }
         else
-            error("Expected valid instruction for body of function definition", "");
+            return error("Expected valid instruction for body of function definition", "");
     }
 
-    return std::make_shared<Function>(funcname, arguments, type, body);
+    return make<Function>(begin, funcname, m_program.list(arguments), type, m_program.list(body));
 }
 
-MaybeNodePtr Parser::parseClass()
+MaybeNodeRef Parser::parseClass()
 {
     /*
         Trying to parse class definition:
@@ -870,34 +1436,28 @@ MaybeNodePtr Parser::parseClass()
         end
     */
 
-    inlineSpace();
-
-    std::string keyword = "";
-    if (!name(&keyword))
-        return {};
-    if (keyword != "cls")
+    std::uint32_t begin = current().offset;
+    if (!accept(TokenType::Cls))
         return {};
-    
-    inlineSpace();
 
-    std::string clsname = "";
-    if (!name(&clsname))
-        error("Expected class name", clsname);
-    
-    if (!endOfLineAndOrComment())
-        error("Expected end of line after class name", "");;
+    Symbol clsname = 0;
+    if (!accept(TokenType::Name, &clsname))
+        return error("Expected class name", "");
+
+    if (!endOfLine())
+        return error("Expected end of line after class name", "");
 
     bool hadconstructor = false;
-    NodePtrList body;
-    NodePtr constructor;
+    std::vector<NodeRef> body;
+    NodeRef constructor = 0;
     while (true)
     {
         // first, try to get a valid instruction
-        if (auto inst = parseInstruction())
+        if (auto inst = parseInstructionOrRecover(/* classBody */ true))
         {
-            if (inst.value()->nodename == "end")
+            if (m_program.get(inst.value()).kind == NodeKind::End)
                 break;
-            else if (inst.value()->nodename == "class constructor")
+            else if (m_program.get(inst.value()).kind == NodeKind::ClsConstructor)
             {
                 if (!hadconstructor)
                 {
@@ -906,20 +1466,22 @@ MaybeNodePtr Parser::parseClass()
                     continue;
                 }
                 else
-                    error("The constructor of a class must be unique", clsname);
+                    return error("The constructor of a class must be unique", std::string(m_program.symbols.name(clsname)));
             }
             else
                 body.push_back(inst.value());
         }
+        else
+            return error("Expected valid instruction for body of class definition", std::string(m_program.symbols.name(clsname)));
     }
 
     if (!hadconstructor)
-        error("Class definition must include a constructor", clsname);
+        return error("Class definition must include a constructor", std::string(m_program.symbols.name(clsname)));
 
-    return std::make_shared<Class>(clsname, constructor, body);
+    return make<Class>(begin, clsname, constructor, m_program.list(body));
 }
 
-MaybeNodePtr Parser::parseConstructor()
+MaybeNodeRef Parser::parseConstructor()
 {
     /*
         Trying to parse constructor definitions such as:
@@ -929,88 +1491,74 @@ MaybeNodePtr Parser::parseConstructor()
         end
     */
 
-    inlineSpace();
-
-    std::string keyword = "";
-    if (!name(&keyword))
-        return {};
-    if (keyword != "new")
+    std::uint32_t begin = current().offset;
+    if (!accept(TokenType::New))
         return {};
-    
-    inlineSpace();
 
     // getting name
-    std::string constructorname = "";
-    if (!name(&constructorname))
+    Symbol constructorname = 0;
+    if (!accept(TokenType::Name, &constructorname))
         return {};
-    
-    inlineSpace();
 
     // getting arguments (enclosed in ())
-    NodePtrList arguments;
-    if (except(IsChar('(')))
+    std::vector<NodeRef> arguments;
+    if (!except(TokenType::LParen))
+        return {};
+
+    while (true)
     {
-        while (true)
-        {
-            // eat the trailing white space
-            inlineSpace();
+        // check if end of arguments
+        if (accept(TokenType::RParen))
+            break;
 
-            // check if end of arguments
-            if (accept(IsChar(')')))
-                break;
+        std::uint32_t argBegin = current().offset;
+        Symbol varname = 0;
+        if (!accept(TokenType::Name, &varname))
+            break;  // we don't have arguments
 
-            std::string varname = "";
-            if (!name(&varname))
-                break;  // we don't have arguments
-            
-            inlineSpace();
-            // : after varname and before type is mandatory
-            if (!except(IsChar(':')))
-                error("Expected ':' after argument name and before type name", "");
-            inlineSpace();
-
-            std::string type = "";
-            if (!name(&type))
-                error("Expected type name for argument in function definition", type);
-            
-            inlineSpace();
-
-            // register argument
-            arguments.push_back(
-                std::make_shared<Declaration>(varname, type)
-            );
+        // : after varname and before type is mandatory
+        if (!accept(TokenType::Colon))
+            return error("Expected ':' after argument name and before type name", "");
 
-            // check for ',' -> other arguments
-            if (accept(IsChar(',')))
-                continue;
-        }
+        Symbol type = 0;
+        if (!accept(TokenType::Name, &type))
+            return error("Expected type name for argument in function definition", "");
+
+        // register argument
+        arguments.push_back(
+            make<Declaration>(argBegin, varname, type)
+        );
+
+        // check for ',' -> other arguments
+        if (accept(TokenType::Comma))
+            continue;
     }
 
-    if (!endOfLineAndOrComment())
-        error("Expected end of line after constructor prototype", "");;
-    
+    if (!endOfLine())
+        return error("Expected end of line after constructor prototype", "");
+
     // getting the body
-    NodePtrList body;
+    std::vector<NodeRef> body;
     while (true)
     {
-        MaybeNodePtr inst = parseInstruction();
+        MaybeNodeRef inst = parseInstructionOrRecover();
 
         // after getting the instruction, check if it's valid
         if (inst)
         {
             // if we found a 'end' token, stop
-            if (inst.value()->nodename == "end")
+            if (m_program.get(inst.value()).kind == NodeKind::End)
                 break;
             body.push_back(inst.value());
         }
         else
-            error("Expected valid instruction for body of constructor definition", "");
+            return error("Expected valid instruction for body of constructor definition", "");
     }
 
-    return std::make_shared<ClsConstructor>(constructorname, arguments, body);
+    return make<ClsConstructor>(begin, constructorname, m_program.list(arguments), m_program.list(body));
 }
 
-MaybeNodePtr Parser::parseRet()
+MaybeNodeRef Parser::parseRet()
 {
     /*
         Trying to parse:
@@ -1018,30 +1566,24 @@ MaybeNodePtr Parser::parseRet()
         ret *expression*
     */
 
-    inlineSpace();
-
-    std::string keyword = "";
-    if (!name(&keyword))
-        return {};
-    if (keyword != "ret")
+    std::uint32_t begin = current().offset;
+    if (!accept(TokenType::Ret))
         return {};
-    
-    inlineSpace();
 
     if (auto expr = parseExp())
     {
-        auto temp = std::make_shared<Ret>(expr.value());
-        if (!endOfLineAndOrComment())
-            error("Expected end of line after return statement", "");;
+        auto temp = make<Ret>(begin, expr.value());
+        if (!endOfLine())
+            return error("Expected end of line after return statement", "");
         return temp;
     }
     else
-        error("Return instruction need a valid value", "");
-    
+        return error("Return instruction need a valid value", "");
+
     return {};
 }
 
-MaybeNodePtr Parser::parseIf()
+MaybeNodeRef Parser::parseIf()
 {
     /*
         Trying to parse:
@@ -1055,63 +1597,56 @@ MaybeNodePtr Parser::parseIf()
         end
     */
 
-    inlineSpace();
-
-    std::string keyword = "";
-    if (!name(&keyword))
+    std::uint32_t begin = current().offset;
+    if (!accept(TokenType::If))
         return {};
-    if (keyword != "if")
-        return {};
-    
+
     // parse condition
     if (auto exp = parseExp())
     {
         // parse 'then'
-        keyword = "";
-        if (!name(&keyword) || keyword != "then")
-            error("Expecting 'then' keyword after condition in if-clause", keyword);
+        if (!accept(TokenType::Then))
+            return error("Expecting 'then' keyword after condition in if-clause", std::string(text(current())));
+
+        if (!endOfLine())
+            return error("Expecting end of line or comment after keyword then", "then");
 
-		if (!endOfLineAndOrComment())
-			error("Expecting end of line or comment after keyword then", keyword);
-        
         bool has_elifs = false;
         bool has_else = false;
 
         // read body
-        NodePtrList body;
+        std::vector<NodeRef> body;
         while (true)
         {
-            MaybeNodePtr inst = parseInstruction();
+            MaybeNodeRef inst = parseInstructionOrRecover();
 
             // after getting the instruction, check if it's valid
             if (inst)
             {
                 // if we found a 'end' token, stop
-                if (inst.value()->nodename == "end")
+                if (m_program.get(inst.value()).kind == NodeKind::End)
                     break;
-                else if (inst.value()->nodename == "elif")
+                else if (m_program.get(inst.value()).kind == NodeKind::Elif)
                 {
                     has_elifs = true;
                     break;
                 }
-                else if (inst.value()->nodename == "else")
+                else if (m_program.get(inst.value()).kind == NodeKind::Else)
                 {
                     has_else = true;
                     break;
                 }
                 body.push_back(inst.value());
-				if (!endOfLineAndOrComment())
-					error("Expecting end of line or comment after instruction", "");
             }
             else
-                error("Expected valid instruction for body of if", "");
+                return error("Expected valid instruction for body of if", "");
         }
 
         // no elifs or else, just return the if
         if (!has_elifs && !has_else)
-            return std::make_shared<IfClause>(exp.value(), body, NodePtrList{}, NodePtrList{});
-        
-        NodePtrList elifClauses;
+            return make<IfClause>(begin, exp.value(), m_program.list(body), NodeList{}, NodeList{});
+
+        std::vector<NodeRef> elifClauses;
 
         if (!has_elifs && has_else)
             goto label_parse_else;
@@ -1125,31 +1660,36 @@ MaybeNodePtr Parser::parseIf()
                 has_elifs = has_else = false;
 
                 // read condition
+                std::uint32_t elifBegin = current().offset;
                 if (auto cond2 = parseExp())
                 {
                     // parse 'then'
-                    keyword = "";
-                    if (!name(&keyword) || keyword != "then")
-                        error("Expecting 'then' keyword after condition in if-clause", keyword);
+                    if (!accept(TokenType::Then))
+                        return error("Expecting 'then' keyword after condition in if-clause", std::string(text(current())));
+
+                    if (!endOfLine())
+                        return error("Expecting end of line or comment after keyword then", "then");
 
                     // read body
-                    NodePtrList bodyElif;
+                    std::vector<NodeRef> bodyElif;
+                    std::size_t bodyEnd = m_pos;
                     while (true)
                     {
-                        MaybeNodePtr inst = parseInstruction();
+                        bodyEnd = m_pos;
+                        MaybeNodeRef inst = parseInstructionOrRecover();
 
                         // after getting the instruction, check if it's valid
                         if (inst)
                         {
                             // if we found a 'end' token, stop
-                            if (inst.value()->nodename == "end")
+                            if (m_program.get(inst.value()).kind == NodeKind::End)
                                 break;
-                            else if (inst.value()->nodename == "elif")
+                            else if (m_program.get(inst.value()).kind == NodeKind::Elif)
                             {
                                 has_elifs = true;
                                 break;
                             }
-                            else if (inst.value()->nodename == "else")
+                            else if (m_program.get(inst.value()).kind == NodeKind::Else)
                             {
                                 has_else = true;
                                 break;
@@ -1157,46 +1697,78 @@ MaybeNodePtr Parser::parseIf()
                             bodyElif.push_back(inst.value());
                         }
                         else
-                            error("Expected valid instruction for body of if", "");
+                            return error("Expected valid instruction for body of if", "");
                     }
 
-                    elifClauses.push_back(std::make_shared<IfClause>(cond2.value(), bodyElif, NodePtrList{}, NodePtrList{}));
+                    // the keyword closing the clause belongs to the next one, or to the whole if-clause
+                    NodeRef clause = m_program.make<IfClause>(cond2.value(), m_program.list(bodyElif), NodeList{}, NodeList{});
+                    m_program.get(clause).span = spanFrom(elifBegin, bodyEnd);
+                    elifClauses.push_back(clause);
 
                     if (!has_elifs)
                         break;
                 }
                 else
-                    error("Expected valid expression as a condition for 'elif'", "");
+                    return error("Expected valid expression as a condition for 'elif'", "");
             }
         }
 
 label_parse_else:
         if (has_else)
         {
-            NodePtrList bodyElse;
+            std::vector<NodeRef> bodyElse;
             while (true)
             {
-                MaybeNodePtr inst = parseInstruction();
+                MaybeNodeRef inst = parseInstructionOrRecover();
 
                 // after getting the instruction, check if it's valid
                 if (inst)
                 {
                     // if we found a 'end' token, stop
-                    if (inst.value()->nodename == "end")
+                    if (m_program.get(inst.value()).kind == NodeKind::End)
                         break;
                     bodyElse.push_back(inst.value());
                 }
                 else
-                    error("Expected valid instruction for body of else", "");
+                    return error("Expected valid instruction for body of else", "");
             }
 
-            return std::make_shared<IfClause>(exp.value(), body, elifClauses, bodyElse);
+            return make<IfClause>(begin, exp.value(), m_program.list(body), m_program.list(elifClauses), m_program.list(bodyElse));
         }
         else
-            return std::make_shared<IfClause>(exp.value(), body, elifClauses, NodePtrList{});
+            return make<IfClause>(begin, exp.value(), m_program.list(body), m_program.list(elifClauses), NodeList{});
     }
     else
-        error("Expected valid expression as a condition for 'if'", "");
-    
+        return error("Expected valid expression as a condition for 'if'", "");
+
     return {};
-}
\ No newline at end of file
+}
+
+MaybeNodeRef Parser::parseElif()
+{
+    /*
+        Trying to parse 'elif' tokens, the condition is read by parseIf
+    */
+
+    std::uint32_t begin = current().offset;
+    if (!accept(TokenType::Elif))
+        return {};
+
+    return make<Elif>(begin);
+}
+
+MaybeNodeRef Parser::parseElse()
+{
+    /*
+        Trying to parse 'else' tokens
+    */
+
+    std::uint32_t begin = current().offset;
+    if (!accept(TokenType::Else))
+        return {};
+
+    auto temp = make<Else>(begin);
+    if (!endOfLine())
+        return error("Expected end of line after keyword else", "");
+    return temp;
+}
@@ -0,0 +1,171 @@
+#include <kafe/project.hpp>
+#include <kafe/internal/threadpool.hpp>
+
+#include <algorithm>
+#include <exception>
+#include <filesystem>
+#include <stdexcept>
+
+using namespace kafe;
+using namespace kafe::internal;
+
+Project::Project(std::vector<std::string> paths) :
+    m_paths(std::move(paths)), m_threads(0), m_errorMode(Parser::ErrorMode::Throw)
+{
+    // the file is stored in the span of the nodes
+    if (m_paths.size() > Span::MaxFile + 1)
+        throw std::length_error("A project can't have more than " + std::to_string(Span::MaxFile + 1) + " files");
+}
+
+Project Project::fromDirectory(const std::string& path)
+{
+    std::vector<std::string> paths;
+    for (const auto& entry : std::filesystem::recursive_directory_iterator(path))
+    {
+        if (entry.is_regular_file() && entry.path().extension() == ".kafe")
+            paths.push_back(entry.path().string());
+    }
+
+    // the directory order depends on the file system
+    std::sort(paths.begin(), paths.end());
+    return Project(std::move(paths));
+}
+
+void Project::setThreads(std::size_t count)
+{
+    m_threads = count;
+}
+
+void Project::setErrorMode(Parser::ErrorMode mode)
+{
+    m_errorMode = mode;
+}
+
+void Project::parse()
+{
+    m_parsers.clear();
+    m_parsers.resize(m_paths.size());
+    m_diagnostics.clear();
+
+    // kept by file, to report the first one in the order of the files
+    std::vector<std::exception_ptr> errors(m_paths.size());
+    {
+        ThreadPool pool(m_threads);
+        for (std::size_t i = 0; i < m_paths.size(); ++i)
+        {
+            pool.submit([this, &errors, i] {
+                try
+                {
+                    auto parser = std::make_unique<Parser>(Parser::fromFile(m_paths[i]));
+                    parser->setFileId(static_cast<std::uint32_t>(i));
+                    // throwing from a thread would depend on which one fails first
+                    parser->setErrorMode(m_errorMode == Parser::ErrorMode::Recover ? Parser::ErrorMode::Recover : Parser::ErrorMode::Collect);
+                    parser->parse();
+                    m_parsers[i] = std::move(parser);
+                }
+                catch (...)
+                {
+                    errors[i] = std::current_exception();
+                }
+            });
+        }
+        pool.wait();
+    }
+
+    for (const std::exception_ptr& error : errors)
+    {
+        if (error)
+            std::rethrow_exception(error);
+    }
+
+    for (std::size_t i = 0; i < m_parsers.size(); ++i)
+    {
+        for (const internal::Diagnostic& diagnostic : m_parsers[i]->getDiagnostics())
+            m_diagnostics.push_back(Diagnostic { i, diagnostic });
+    }
+
+    collectGlobals();
+
+    if (m_errorMode == Parser::ErrorMode::Throw && !m_diagnostics.empty())
+    {
+        const Diagnostic& first = m_diagnostics.front();
+        const internal::Diagnostic& d = first.diagnostic;
+        throw ParseError(m_paths[first.file] + ": " + d.what, d.row, d.col, d.exp, d.sym);
+    }
+}
+
+void Project::collectGlobals()
+{
+    m_globals.clear();
+    m_globalsByName.clear();
+
+    for (std::size_t i = 0; i < m_parsers.size(); ++i)
+    {
+        Program& program = m_parsers[i]->getProgram();
+
+        for (NodeRef ref : program.children)
+        {
+            Node& node = program.get(ref);
+
+            Global global { {}, Global::Kind::Class, i, ref };
+            if (node.kind == NodeKind::Class)
+                global.name = program.symbols.name(program.get<Class>(ref).name);
+            else if (node.kind == NodeKind::Function)
+            {
+                global.kind = Global::Kind::Function;
+                global.name = program.symbols.name(program.get<Function>(ref).name);
+            }
+            else if (node.kind == NodeKind::ConstDef)
+            {
+                global.kind = Global::Kind::Constant;
+                global.name = program.symbols.name(program.get<ConstDef>(ref).varname);
+            }
+            else
+                continue;
+
+            // the first definition wins, the next ones are errors
+            if (m_globalsByName.count(global.name) != 0)
+            {
+                Position pos = m_parsers[i]->getPosition(node.span);
+                m_diagnostics.push_back(Diagnostic {
+                    i, internal::Diagnostic { "Redefinition of '" + std::string(global.name) + "'", pos.row, pos.col, std::string(global.name), 0 }
+                });
+                continue;
+            }
+
+            m_globalsByName.emplace(global.name, m_globals.size());
+            m_globals.push_back(global);
+        }
+    }
+}
+
+const std::vector<Project::Diagnostic>& Project::getDiagnostics()
+{
+    return m_diagnostics;
+}
+
+const std::vector<Project::Global>& Project::getGlobals()
+{
+    return m_globals;
+}
+
+const Project::Global* Project::getGlobal(std::string_view name)
+{
+    auto it = m_globalsByName.find(name);
+    return it == m_globalsByName.end() ? nullptr : &m_globals[it->second];
+}
+
+std::size_t Project::size() const
+{
+    return m_paths.size();
+}
+
+const std::string& Project::getPath(std::size_t file)
+{
+    return m_paths[file];
+}
+
+Parser& Project::getParser(std::size_t file)
+{
+    return *m_parsers[file];
+}
@@ -0,0 +1,778 @@
+#include <kafe/vm.hpp>
+
+#include <algorithm>
+#include <utility>
+
+// GCC and Clang can jump to the address of a label: each instruction jumps
+// directly to the next one, instead of going back to a single switch
+#if (defined(__GNUC__) || defined(__clang__)) && !defined(KAFE_SWITCH_DISPATCH)
+    #define KAFE_COMPUTED_GOTO
+#endif
+
+using namespace kafe;
+using namespace kafe::internal;
+
+namespace
+{
+    const char* typeName(const Value& value)
+    {
+        switch (value.type)
+        {
+            case ValueType::Nil:      return "nil";
+            case ValueType::Int:      return "int";
+            case ValueType::Float:    return "float";
+            case ValueType::String:   return "string";
+            case ValueType::Bool:     return "bool";
+            case ValueType::Instance: break;
+        }
+        return "instance";
+    }
+
+    bool isNumber(const Value& value)
+    {
+        return value.type == ValueType::Int || value.type == ValueType::Float;
+    }
+
+    double toFloat(const Value& value)
+    {
+        return value.type == ValueType::Int ? static_cast<double>(value.integer) : value.real;
+    }
+
+    // integer operations wrap around instead of overflowing
+    std::int64_t wrap(std::uint64_t value)
+    {
+        return static_cast<std::int64_t>(value);
+    }
+
+    bool equals(const Value& x, const Value& y)
+    {
+        if (x.type != y.type)
+            return isNumber(x) && isNumber(y) && toFloat(x) == toFloat(y);
+
+        switch (x.type)
+        {
+            case ValueType::Nil:      return true;
+            case ValueType::Int:      return x.integer == y.integer;
+            case ValueType::Float:    return x.real == y.real;
+            case ValueType::String:   return x.string->text == y.string->text;
+            case ValueType::Bool:     return x.boolean == y.boolean;
+            case ValueType::Instance: break;
+        }
+        return x.instance == y.instance;
+    }
+
+    // result of a comparison (Lt, Le, Gt, Ge) from the sign of x - y
+    bool compared(Op op, int sign)
+    {
+        switch (op)
+        {
+            case Op::Lt: return sign < 0;
+            case Op::Le: return sign <= 0;
+            case Op::Gt: return sign > 0;
+            default:     return sign >= 0;
+        }
+    }
+
+    const char* const OpSymbols[] = { "+", "-", "*", "/", "<<", ">>", "==", "!=", "<", "<=", ">", ">=" };
+
+    void printValue(std::ostream& os, const Value& value)
+    {
+        switch (value.type)
+        {
+            case ValueType::Nil:      os << "nil"; break;
+            case ValueType::Int:      os << value.integer; break;
+            case ValueType::Float:    os << value.real; break;
+            case ValueType::String:   os << value.string->text; break;
+            case ValueType::Bool:     os << (value.boolean ? "true" : "false"); break;
+            case ValueType::Instance: os << "<" << value.instance->cls->name << ">"; break;
+        }
+    }
+}
+
+VM::VM(std::size_t stackSize) :
+    m_stack(stackSize), m_top(m_stack.data()), m_executed(0),
+    m_objects(nullptr), m_objectCount(0), m_nextCollection(1024), m_output(&std::cout)
+{
+    addNative("print", &VM::print);
+}
+
+VM::~VM()
+{
+    while (m_objects != nullptr)
+    {
+        Object* next = m_objects->next;
+        if (m_objects->type == ValueType::String)
+            delete static_cast<StringObject*>(m_objects);
+        else
+            delete static_cast<Instance*>(m_objects);
+        m_objects = next;
+    }
+}
+
+void VM::feed(const std::vector<std::uint8_t>& bytecode)
+{
+    auto module = std::make_unique<Module>();
+    module->data = bytecode;
+    const std::uint8_t* data = module->data.data();
+    load(std::move(module), data, bytecode.size());
+}
+
+void VM::feedFile(const std::string& path)
+{
+    auto module = std::make_unique<Module>();
+    std::string_view view = module->file.emplace(path).view();
+    load(std::move(module), reinterpret_cast<const std::uint8_t*>(view.data()), view.size());
+}
+
+void VM::load(std::unique_ptr<Module> module, const std::uint8_t* data, std::size_t size)
+{
+    module->bytecode = BytecodeView::read(data, size);
+    const BytecodeView& b = module->bytecode;
+
+    module->slots.reserve(b.symbols.size());
+    for (std::string_view symbol : b.symbols)
+        module->slots.push_back(slot(symbol));
+
+    // never reallocated, the constants point to the strings
+    std::size_t strings = 0;
+    for (const Constant& constant : b.constants)
+        strings += static_cast<ConstantType>(constant.index()) == ConstantType::String ? 1 : 0;
+    module->strings.reserve(strings);
+
+    module->constants.reserve(b.constants.size());
+    for (const Constant& constant : b.constants)
+    {
+        switch (static_cast<ConstantType>(constant.index()))
+        {
+            case ConstantType::Nil:   module->constants.emplace_back(); break;
+            case ConstantType::Int:   module->constants.emplace_back(std::get<std::int64_t>(constant)); break;
+            case ConstantType::Float: module->constants.emplace_back(std::get<double>(constant)); break;
+            case ConstantType::Bool:  module->constants.emplace_back(std::get<bool>(constant)); break;
+
+            case ConstantType::String:
+                // pointing to the text of the symbol, in the data of the module
+                module->strings.emplace_back(b.symbols[std::get<std::uint32_t>(constant)]);
+                module->constants.emplace_back(&module->strings.back());
+                break;
+        }
+    }
+
+    module->classes.resize(b.classes.size());
+    for (std::size_t i = 0; i < b.classes.size(); ++i)
+    {
+        ClassData& cls = module->classes[i];
+        cls.name = b.symbols[b.classes[i].name];
+        for (const Attribute& attribute : b.classes[i].attributes)
+            cls.defaults.push_back(module->constants[attribute.value]);
+    }
+
+    module->functions.resize(b.segments.size());
+    for (std::size_t i = 0; i < b.segments.size(); ++i)
+    {
+        const SegmentView& segment = b.segments[i];
+        FunctionData& function = module->functions[i];
+        function.name = segment.name != NoIndex ? b.symbols[segment.name] : std::string_view();
+        function.module = module.get();
+        function.code = segment.code;
+        function.arguments = segment.arguments;
+        function.registers = segment.registers;
+
+        if (i == 0)
+            continue;
+
+        if (segment.cls == NoIndex)
+            // a function defined again replaces the previous one
+            m_slots[module->slots[segment.name]].function = &function;
+        else
+        {
+            // the first segment of a class is its constructor
+            ClassData& cls = module->classes[segment.cls];
+            function.cls = &cls;
+            if (cls.constructor == nullptr && segment.name == b.classes[segment.cls].name)
+                cls.constructor = &function;
+            else
+                cls.methods.emplace_back(module->slots[segment.name], &function);
+        }
+    }
+
+    for (std::size_t i = 0; i < b.classes.size(); ++i)
+        m_slots[module->slots[b.classes[i].name]].cls = &module->classes[i];
+
+    m_modules.push_back(std::move(module));
+}
+
+void VM::exec()
+{
+    while (m_executed < m_modules.size())
+    {
+        // not run again if it fails
+        const Module& module = *m_modules[m_executed++];
+        execute(&module.functions[0], m_top);
+    }
+}
+
+VM::Handle VM::getHandle(std::string_view name)
+{
+    auto it = m_slotIndices.find(name);
+    if (it != m_slotIndices.end())
+        return Handle(it->second);
+
+    // the name given may not live long enough
+    m_names.emplace_back(name);
+    return Handle(slot(m_names.back()));
+}
+
+const FunctionData* VM::prepareCall(std::uint32_t slot, std::size_t count)
+{
+    const Slot& s = m_slots[slot];
+    if (s.function == nullptr)
+        throw RuntimeError("Unknown function '" + std::string(s.name) + "'");
+    if (s.function->native == nullptr && count != s.function->arguments)
+        throw RuntimeError("Wrong number of arguments for '" + std::string(s.name) + "'");
+    // the result needs a register even without arguments
+    if (static_cast<std::size_t>(m_stack.data() + m_stack.size() - m_top) < std::max<std::size_t>(count, 1))
+        throw RuntimeError("Stack overflow");
+    return s.function;
+}
+
+void VM::finishCall(const FunctionData* function, std::size_t count)
+{
+    Value* base = m_top - count;
+    if (function->native != nullptr)
+        function->native(*this, base, count);
+    else
+    {
+        // execute() gives the arguments back to the function as its registers
+        m_top = base;
+        execute(function, base);
+    }
+    m_top = base;
+}
+
+Value VM::makeString(std::string_view text)
+{
+    return Value(allocate<StringObject>(std::string(text)));
+}
+
+void VM::conversionError(std::uint32_t slot, const char* what, const char* type, const Value& value)
+{
+    throw RuntimeError(std::string(what) + " '" + std::string(m_slots[slot].name) + "' has the type " + typeName(value) + ", not " + type);
+}
+
+void VM::setOutput(std::ostream& os)
+{
+    m_output = &os;
+}
+
+std::size_t VM::getObjectCount()
+{
+    return m_objectCount;
+}
+
+std::uint32_t VM::slot(std::string_view name)
+{
+    auto it = m_slotIndices.find(name);
+    if (it != m_slotIndices.end())
+        return it->second;
+
+    std::uint32_t index = static_cast<std::uint32_t>(m_slots.size());
+    m_slots.emplace_back();
+    m_slots.back().name = name;
+    m_slotIndices.emplace(name, index);
+    return index;
+}
+
+void VM::addNative(std::string_view name, Native native)
+{
+    m_natives.push_back(std::make_unique<FunctionData>());
+    FunctionData& function = *m_natives.back();
+    function.native = native;
+
+    Slot& s = m_slots[slot(name)];
+    function.name = s.name;
+    s.function = &function;
+}
+
+void VM::print(VM& vm, Value* args, std::size_t count)
+{
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        if (i > 0)
+            *vm.m_output << " ";
+        printValue(*vm.m_output, args[i]);
+    }
+    *vm.m_output << "\n";
+    args[0] = Value();
+}
+
+template <typename T, typename... Args>
+T* VM::allocate(Args&&... args)
+{
+    if (m_objectCount >= m_nextCollection)
+        collectGarbage();
+
+    T* object = new T(std::forward<Args>(args)...);
+    object->next = m_objects;
+    m_objects = object;
+    ++m_objectCount;
+    return object;
+}
+
+void VM::collectGarbage()
+{
+    // marking everything reachable from the registers in use and the globals
+    std::vector<Object*> pending;
+    for (const Value* value = m_stack.data(); value < m_top; ++value)
+        mark(pending, *value);
+    for (const Slot& s : m_slots)
+        mark(pending, s.value);
+
+    while (!pending.empty())
+    {
+        Object* object = pending.back();
+        pending.pop_back();
+        if (object->type == ValueType::Instance)
+        {
+            for (const Value& field : static_cast<Instance*>(object)->fields)
+                mark(pending, field);
+        }
+    }
+
+    // then freeing the other ones
+    Object** link = &m_objects;
+    while (*link != nullptr)
+    {
+        Object* object = *link;
+        if (object->marked)
+        {
+            object->marked = false;
+            link = &object->next;
+            continue;
+        }
+
+        *link = object->next;
+        if (object->type == ValueType::String)
+            delete static_cast<StringObject*>(object);
+        else
+            delete static_cast<Instance*>(object);
+        --m_objectCount;
+    }
+
+    m_nextCollection = std::max<std::size_t>(1024, m_objectCount * 2);
+}
+
+void VM::mark(std::vector<Object*>& pending, Value value)
+{
+    // the strings of the constants are never freed, they stay marked
+    if (value.isObject() && !value.object->marked)
+    {
+        value.object->marked = true;
+        pending.push_back(value.object);
+    }
+}
+
+Value VM::binary(const FunctionData* function, Op op, const Value& x, const Value& y)
+{
+    if (x.type == ValueType::Int && y.type == ValueType::Int)
+    {
+        std::uint64_t a = static_cast<std::uint64_t>(x.integer);
+        std::uint64_t b = static_cast<std::uint64_t>(y.integer);
+
+        switch (op)
+        {
+            case Op::Add: return Value(wrap(a + b));
+            case Op::Sub: return Value(wrap(a - b));
+            case Op::Mul: return Value(wrap(a * b));
+            case Op::Div:
+                if (y.integer == 0)
+                    error(function, "Division by zero");
+                // the only division which overflows
+                if (y.integer == -1)
+                    return Value(wrap(0 - a));
+                return Value(x.integer / y.integer);
+            // only the 6 lowest bits of the shift are used
+            case Op::Shl: return Value(wrap(a << (b & 63)));
+            case Op::Shr: return Value(x.integer >> (b & 63));
+            default:      break;
+        }
+    }
+
+    if (op == Op::Eq)
+        return Value(equals(x, y));
+    if (op == Op::Ne)
+        return Value(!equals(x, y));
+
+    if (isNumber(x) && isNumber(y) && op != Op::Shl && op != Op::Shr)
+    {
+        if (x.type == ValueType::Int && y.type == ValueType::Int)
+            return Value(compared(op, x.integer < y.integer ? -1 : x.integer > y.integer ? 1 : 0));
+
+        double a = toFloat(x);
+        double b = toFloat(y);
+        switch (op)
+        {
+            case Op::Add: return Value(a + b);
+            case Op::Sub: return Value(a - b);
+            case Op::Mul: return Value(a * b);
+            case Op::Div: return Value(a / b);
+            case Op::Lt:  return Value(a < b);
+            case Op::Le:  return Value(a <= b);
+            case Op::Gt:  return Value(a > b);
+            default:      return Value(a >= b);
+        }
+    }
+
+    if (x.type == ValueType::String && y.type == ValueType::String)
+    {
+        if (op == Op::Add)
+        {
+            std::string text;
+            text.reserve(x.string->text.size() + y.string->text.size());
+            text.append(x.string->text).append(y.string->text);
+            return Value(allocate<StringObject>(std::move(text)));
+        }
+        if (op != Op::Sub && op != Op::Mul && op != Op::Div && op != Op::Shl && op != Op::Shr)
+            return Value(compared(op, x.string->text.compare(y.string->text)));
+    }
+
+    error(function, std::string("Unsupported operands for '") + OpSymbols[static_cast<std::size_t>(op) - static_cast<std::size_t>(Op::Add)] +
+                    "': " + typeName(x) + " and " + typeName(y));
+}
+
+void VM::error(const FunctionData* function, const std::string& what)
+{
+    if (function->name.empty())
+        throw RuntimeError(what + " (at the top level)");
+    throw RuntimeError(what + " (in '" + std::string(function->name) + "')");
+}
+
+void VM::execute(const FunctionData* function, Value* base)
+{
+    const std::size_t depth = m_frames.size();
+    Value* const top = m_top;
+    const Value* const stackEnd = m_stack.data() + m_stack.size();
+
+    // state of the running function
+    const FunctionData* fn = function;
+    Value* r = base;
+    const std::uint8_t* pc = nullptr;
+    const Value* constants = nullptr;
+    const std::uint32_t* slots = nullptr;
+
+    // give its registers to the function in fn, starting at r
+    auto enter = [&]() {
+        Value* end = r + fn->registers;
+        if (end > stackEnd)
+            error(fn, "Stack overflow");
+
+        // the registers above the arguments may hold old values, which could have been freed
+        for (Value* v = r + fn->arguments + (fn->cls != nullptr ? 1 : 0); v < end; ++v)
+            *v = Value();
+
+        m_top = end;
+        pc = fn->code;
+        constants = fn->module->constants.data();
+        slots = fn->module->slots.data();
+    };
+
+    // save the running function before calling another one, which returns to next
+    auto call = [&](const FunctionData* callee, std::uint32_t a, bool constructor, std::uint32_t count, const std::uint8_t* next) {
+        if (count != callee->arguments)
+            error(fn, "Wrong number of arguments for '" + std::string(callee->name) + "'");
+
+        m_frames.push_back(Frame { fn, r, next, constructor });
+        fn = callee;
+        r += a;
+        enter();
+    };
+
+    // the arguments of the instruction at pc, on W bytes each (1, or 4 after a Wide prefix)
+    #define ARG(i) (W == 1 ? static_cast<std::uint32_t>(pc[1 + (i)]) : \
+        static_cast<std::uint32_t>(pc[1 + 4 * (i)] | pc[2 + 4 * (i)] << 8 | pc[3 + 4 * (i)] << 16) | \
+        static_cast<std::uint32_t>(pc[4 + 4 * (i)]) << 24)
+    #define REG(i) r[ARG(i)]
+    // the instruction after the one at pc, which has n arguments
+    #define NEXT(n) (pc + 1 + W * (n))
+
+    // an instruction, written once for both sizes of arguments
+    #define OP(name, ...) \
+        CASE(name) \
+        { \
+            constexpr std::size_t W = 1; \
+            __VA_ARGS__ \
+        } \
+        WIDE_CASE(name) \
+        { \
+            constexpr std::size_t W = 4; \
+            __VA_ARGS__ \
+        }
+
+    // fast path of the integer operations, which wrap around
+    #define INT_BINARY(name, expr) \
+        OP(name, \
+            const Value& x = REG(1); \
+            const Value& y = REG(2); \
+            if (x.type == ValueType::Int && y.type == ValueType::Int) \
+                REG(0) = Value(expr); \
+            else \
+                REG(0) = binary(fn, Op::name, x, y); \
+            pc = NEXT(3); \
+            DISPATCH(); \
+        )
+
+    #define BINARY(name) \
+        OP(name, \
+            REG(0) = binary(fn, Op::name, REG(1), REG(2)); \
+            pc = NEXT(3); \
+            DISPATCH(); \
+        )
+
+#ifdef KAFE_COMPUTED_GOTO
+    // by op code
+    static const void* const labels[] = {
+        &&op_LoadConst, &&op_Move, &&op_LoadGlobal, &&op_StoreGlobal, &&op_GetField, &&op_SetField,
+        &&op_Add, &&op_Sub, &&op_Mul, &&op_Div, &&op_Shl, &&op_Shr,
+        &&op_Eq, &&op_Ne, &&op_Lt, &&op_Le, &&op_Gt, &&op_Ge,
+        &&op_Neg, &&op_BitNot, &&op_Not, &&op_Jump, &&op_JumpIfFalse, &&op_JumpIfTrue,
+        &&op_Call, &&op_CallMethod, &&op_New, &&op_Return, &&op_Wide
+    };
+    static_assert(sizeof(labels) / sizeof(labels[0]) == static_cast<std::size_t>(Op::Count), "an op is missing");
+
+    // the same ones, after a Wide prefix
+    static const void* const wideLabels[] = {
+        &&wide_LoadConst, &&wide_Move, &&wide_LoadGlobal, &&wide_StoreGlobal, &&wide_GetField, &&wide_SetField,
+        &&wide_Add, &&wide_Sub, &&wide_Mul, &&wide_Div, &&wide_Shl, &&wide_Shr,
+        &&wide_Eq, &&wide_Ne, &&wide_Lt, &&wide_Le, &&wide_Gt, &&wide_Ge,
+        &&wide_Neg, &&wide_BitNot, &&wide_Not, &&wide_Jump, &&wide_JumpIfFalse, &&wide_JumpIfTrue,
+        &&wide_Call, &&wide_CallMethod, &&wide_New, &&wide_Return
+    };
+    static_assert(sizeof(wideLabels) / sizeof(wideLabels[0]) == static_cast<std::size_t>(Op::Wide), "an op is missing");
+
+    // the op codes were checked when reading the bytecode
+    #define CASE(name) op_##name:
+    #define WIDE_CASE(name) wide_##name:
+    #define DISPATCH() goto *labels[*pc]
+#else
+    // the op codes after a Wide prefix are shifted, to be handled by the same switch
+    constexpr unsigned WideOps = 256;
+    #define CASE(name) case static_cast<unsigned>(Op::name):
+    #define WIDE_CASE(name) case WideOps + static_cast<unsigned>(Op::name):
+    #define DISPATCH() break
+#endif
+
+    try
+    {
+        enter();
+
+#ifdef KAFE_COMPUTED_GOTO
+        DISPATCH();
+
+        // the prefix is skipped, the instruction being read with its arguments on 4 bytes
+        op_Wide:
+            ++pc;
+            goto *wideLabels[*pc];
+#else
+        while (true)
+        {
+            unsigned op = *pc;
+            if (op == static_cast<unsigned>(Op::Wide))
+                op = WideOps + *++pc;
+
+            switch (op)
+            {
+#endif
+        OP(LoadConst,
+            REG(0) = constants[ARG(1)];
+            pc = NEXT(2);
+            DISPATCH();
+        )
+
+        OP(Move,
+            REG(0) = REG(1);
+            pc = NEXT(2);
+            DISPATCH();
+        )
+
+        OP(LoadGlobal,
+            const Slot& s = m_slots[slots[ARG(1)]];
+            if (!s.defined)
+                error(fn, "Undefined variable '" + std::string(s.name) + "'");
+            REG(0) = s.value;
+            pc = NEXT(2);
+            DISPATCH();
+        )
+
+        OP(StoreGlobal,
+            Slot& s = m_slots[slots[ARG(0)]];
+            s.value = REG(1);
+            s.defined = true;
+            pc = NEXT(2);
+            DISPATCH();
+        )
+
+        OP(GetField,
+            const Value& instance = REG(1);
+            std::uint32_t field = ARG(2);
+            if (instance.type != ValueType::Instance || field >= instance.instance->fields.size())
+                error(fn, "No attribute " + std::to_string(field) + " in a value of type " + typeName(instance));
+            REG(0) = instance.instance->fields[field];
+            pc = NEXT(3);
+            DISPATCH();
+        )
+
+        OP(SetField,
+            const Value& instance = REG(0);
+            std::uint32_t field = ARG(1);
+            if (instance.type != ValueType::Instance || field >= instance.instance->fields.size())
+                error(fn, "No attribute " + std::to_string(field) + " in a value of type " + typeName(instance));
+            instance.instance->fields[field] = REG(2);
+            pc = NEXT(3);
+            DISPATCH();
+        )
+
+        INT_BINARY(Add, wrap(static_cast<std::uint64_t>(x.integer) + static_cast<std::uint64_t>(y.integer)))
+        INT_BINARY(Sub, wrap(static_cast<std::uint64_t>(x.integer) - static_cast<std::uint64_t>(y.integer)))
+        INT_BINARY(Mul, wrap(static_cast<std::uint64_t>(x.integer) * static_cast<std::uint64_t>(y.integer)))
+        BINARY(Div)
+        BINARY(Shl)
+        BINARY(Shr)
+        INT_BINARY(Eq, x.integer == y.integer)
+        INT_BINARY(Ne, x.integer != y.integer)
+        INT_BINARY(Lt, x.integer < y.integer)
+        INT_BINARY(Le, x.integer <= y.integer)
+        INT_BINARY(Gt, x.integer > y.integer)
+        INT_BINARY(Ge, x.integer >= y.integer)
+
+        OP(Neg,
+            const Value& x = REG(1);
+            if (x.type == ValueType::Int)
+                REG(0) = Value(wrap(0 - static_cast<std::uint64_t>(x.integer)));
+            else if (x.type == ValueType::Float)
+                REG(0) = Value(-x.real);
+            else
+                error(fn, std::string("Unsupported operand for '-': ") + typeName(x));
+            pc = NEXT(2);
+            DISPATCH();
+        )
+
+        OP(BitNot,
+            const Value& x = REG(1);
+            if (x.type != ValueType::Int)
+                error(fn, std::string("Unsupported operand for '~': ") + typeName(x));
+            REG(0) = Value(~x.integer);
+            pc = NEXT(2);
+            DISPATCH();
+        )
+
+        OP(Not,
+            REG(0) = Value(!REG(1).isTrue());
+            pc = NEXT(2);
+            DISPATCH();
+        )
+
+        OP(Jump,
+            pc = fn->code + ARG(0);
+            DISPATCH();
+        )
+
+        OP(JumpIfFalse,
+            pc = REG(0).isTrue() ? NEXT(2) : fn->code + ARG(1);
+            DISPATCH();
+        )
+
+        OP(JumpIfTrue,
+            pc = REG(0).isTrue() ? fn->code + ARG(1) : NEXT(2);
+            DISPATCH();
+        )
+
+        OP(Call,
+            const Slot& s = m_slots[slots[ARG(1)]];
+            if (s.function == nullptr)
+                error(fn, "Unknown function '" + std::string(s.name) + "'");
+
+            if (s.function->native != nullptr)
+            {
+                s.function->native(*this, &REG(0), ARG(2));
+                pc = NEXT(3);
+            }
+            else
+                call(s.function, ARG(0), false, ARG(2), NEXT(3));
+            DISPATCH();
+        )
+
+        OP(CallMethod,
+            const Value& instance = REG(0);
+            std::uint32_t name = slots[ARG(1)];
+            if (instance.type != ValueType::Instance)
+                error(fn, "Method '" + std::string(m_slots[name].name) + "' called on a value of type " + typeName(instance));
+
+            // a class only has a few methods
+            const auto& methods = instance.instance->cls->methods;
+            auto method = std::find_if(methods.begin(), methods.end(), [name](const auto& m) { return m.first == name; });
+            if (method == methods.end())
+                error(fn, "No method '" + std::string(m_slots[name].name) + "' in the class " + std::string(instance.instance->cls->name));
+
+            call(method->second, ARG(0), false, ARG(2), NEXT(3));
+            DISPATCH();
+        )
+
+        OP(New,
+            const Slot& s = m_slots[slots[ARG(1)]];
+            if (s.cls == nullptr)
+                error(fn, "Unknown class '" + std::string(s.name) + "'");
+
+            REG(0) = Value(allocate<Instance>(s.cls));
+            if (s.cls->constructor != nullptr)
+                call(s.cls->constructor, ARG(0), true, ARG(2), NEXT(3));
+            else
+                pc = NEXT(3);
+            DISPATCH();
+        )
+
+        OP(Return,
+            Value result = REG(0);
+            if (m_frames.size() == depth)
+            {
+                r[0] = result;
+                m_top = top;
+                return;
+            }
+
+            // the result goes to the first register given to the function
+            Frame frame = m_frames.back();
+            m_frames.pop_back();
+            if (!frame.constructor)
+                r[0] = result;
+
+            fn = frame.function;
+            r = frame.base;
+            pc = frame.pc;
+            m_top = r + fn->registers;
+            constants = fn->module->constants.data();
+            slots = fn->module->slots.data();
+            DISPATCH();
+        )
+#ifndef KAFE_COMPUTED_GOTO
+                default:
+                    error(fn, "Unknown op code");
+            }
+        }
+#endif
+    }
+    catch (...)
+    {
+        m_frames.resize(depth);
+        m_top = top;
+        throw;
+    }
+
+    #undef ARG
+    #undef REG
+    #undef NEXT
+    #undef OP
+    #undef INT_BINARY
+    #undef BINARY
+    #undef CASE
+    #undef WIDE_CASE
+    #undef DISPATCH
+}
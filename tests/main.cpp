@@ -5,6 +5,7 @@
 #include <sstream>
 #include <filesystem>
 #include <string>
+#include <map>
 
 
 #include <cstdio>
@@ -23,6 +24,15 @@ void handleParseErrors(kafe::Parser& p)
     }
 }
 
+// one diagnostic per line: row:col what
+std::string diagnosticsToString(kafe::Parser& p)
+{
+    std::ostringstream os;
+    for (const auto& d : p.getDiagnostics())
+        os << d.row << ":" << d.col << " " << d.what << "\n";
+    return os.str();
+}
+
 int main()
 {
     std::cout << "Kafe tests" << "\n"
@@ -46,6 +56,8 @@ int main()
     std::size_t i = 0;
     std::size_t passed = 0;
     std::size_t failed = 0;
+    // AST of each file, to compare with the project
+    std::map<std::string, std::string> asts;
 
     // testing each file :
     //    comparing generated AST and output
@@ -54,17 +66,236 @@ int main()
 		std::cout << "Test '" << file << "' (" << i << ")" << std::endl;
 
         // parsing
-        kafe::Parser p(readFile(file));
+        auto p = kafe::Parser::fromFile(file);
         handleParseErrors(p);
 
         // getting AST
         std::ostringstream os;
         p.ASTtoString(os);
 
+        // the packrat mode must give the exact same AST
+        auto packrat = kafe::Parser::fromFile(file);
+        packrat.setPackrat(true);
+        handleParseErrors(packrat);
+
+        std::ostringstream packratOs;
+        packrat.ASTtoString(packratOs);
+
+        if (packratOs.str() != os.str())
+            std::cout << "Packrat mode gave a different AST" << std::endl;
+
+        // streaming the instructions one by one must give them all, in order
+        auto streaming = kafe::Parser::fromFile(file);
+        std::ostringstream streamingOs;
+        streamingOs << "(Program";
+        try
+        {
+            streaming.parse([&](kafe::internal::Program& program, kafe::internal::NodeRef inst) {
+                streamingOs << "\n";
+                program.toString(inst, streamingOs, 1);
+            });
+        }
+        catch (const kafe::internal::ParseError&)
+        {}
+        streamingOs << "\n)";
+
+        if (streamingOs.str() != os.str())
+            std::cout << "Streaming mode gave a different AST" << std::endl;
+
+        // parsing without the middle line, then reparsing after putting it back, must give the same AST
+        auto code = readFile(file);
+        std::size_t lineStart = code.rfind('\n', code.size() / 2);
+        lineStart = lineStart == std::string::npos ? 0 : lineStart + 1;
+        std::size_t lineEnd = std::min(code.find('\n', lineStart), code.size());
+        std::string edited = code.substr(0, lineStart) + code.substr(lineEnd);
+
+        kafe::Parser incremental(edited);
+        handleParseErrors(incremental);
+        try
+        {
+            incremental.reparse(code, { static_cast<std::uint32_t>(lineStart), 0, static_cast<std::uint32_t>(lineEnd - lineStart) });
+        }
+        catch (const kafe::internal::ParseError&)
+        {}
+
+        std::ostringstream incrementalOs;
+        incremental.ASTtoString(incrementalOs);
+
+        if (incrementalOs.str() != os.str())
+            std::cout << "Incremental reparse gave a different AST" << std::endl;
+
+        asts[file] = os.str();
+
+        // the bytecode must be read back and written again without any change
+        bool roundTrip = false;
+        std::vector<std::uint8_t> bytecode;
+        try
+        {
+            bytecode = p.generateBytecode();
+            auto decoded = kafe::internal::Bytecode::read(bytecode.data(), bytecode.size());
+            roundTrip = decoded.write() == bytecode;
+        }
+        catch (const std::runtime_error& e)
+        {
+            std::cout << "Bytecode error: " << e.what() << std::endl;
+        }
+
+        if (!roundTrip)
+            std::cout << "The bytecode didn't survive a round trip" << std::endl;
+
+        // running the bytecode must print the wanted output, if there is one
+        bool outputOk = true;
+        if (roundTrip && std::filesystem::exists(file + ".output"))
+        {
+            std::ostringstream output;
+            kafe::VM vm;
+            vm.setOutput(output);
+            try
+            {
+                vm.feed(bytecode);
+                vm.exec();
+            }
+            catch (const kafe::internal::RuntimeError& e)
+            {
+                output << "RuntimeError: " << e.what() << "\n";
+            }
+
+            auto wanted = readFile(file + ".output");
+            outputOk = output.str() == wanted;
+            if (!outputOk)
+                std::cout << "Wrong output:\n" << output.str() << "===========================\n" << wanted << std::endl;
+        }
+
         // comparing with what we need to have
         auto content = readFile(file + ".expected");
 
-        if (deepCompareString(os.str(), content))
+        if (deepCompareString(os.str(), content) && packratOs.str() == os.str() && streamingOs.str() == os.str() &&
+            incrementalOs.str() == os.str() && roundTrip && outputOk)
+            ++passed;
+        else
+        {
+            ++failed;
+            std::cout << "Test '" << file << "' (" << i << ") failed" << std::endl;
+            std::cout << os.str() << std::endl;
+            std::cout << "===========================" << std::endl;
+            std::cout << content << std::endl;
+        }
+
+        ++i;
+    }
+
+    // the nested calls try the same rules again at the same tokens, the packrat mode must reuse their results
+    std::cout << "Test 'packrat' (" << i << ")" << std::endl;
+    bool packratOk = false;
+    {
+        std::string code = "x: int = f(f(f(1 + 2)))\n";
+        kafe::Parser plain(code);
+        plain.parse();
+        kafe::Parser packrat(code);
+        packrat.setPackrat(true);
+        packrat.parse();
+
+        std::ostringstream plainOs;
+        plain.ASTtoString(plainOs);
+        std::ostringstream packratOs;
+        packrat.ASTtoString(packratOs);
+        packratOk = packrat.getPackratHits() > 0 && packratOs.str() == plainOs.str();
+
+        // the hits of a reparse are added to the previous ones
+        std::size_t hits = packrat.getPackratHits();
+        std::string edited = code;
+        edited[edited.find('2')] = '3';
+        packrat.reparse(edited, { static_cast<std::uint32_t>(code.find('2')), 1, 1 });
+        packratOk = packratOk && packrat.getPackratHits() > hits;
+        if (!packratOk)
+            std::cout << "Packrat hits: " << packrat.getPackratHits() << std::endl;
+    }
+
+    if (packratOk)
+        ++passed;
+    else
+    {
+        ++failed;
+        std::cout << "Test 'packrat' (" << i << ") failed" << std::endl;
+    }
+    ++i;
+
+    // broken files: comparing the diagnostics and the AST which survived the recovery
+    std::vector<std::string> brokenFiles;
+    for (const auto& entry : std::filesystem::directory_iterator("./errors/"))
+    {
+        if (entry.path().extension() == ".kafe")
+            brokenFiles.push_back(entry.path().string());
+    }
+    std::sort(brokenFiles.begin(), brokenFiles.end());
+
+    for (auto file: brokenFiles)
+    {
+        std::cout << "Test '" << file << "' (" << i << ")" << std::endl;
+        auto wanted = readFile(file + ".diagnostics");
+        auto firstError = wanted.substr(0, wanted.find('\n') + 1);
+        bool ok = !firstError.empty();
+
+        // the default mode throws the first error
+        try
+        {
+            auto p = kafe::Parser::fromFile(file);
+            p.parse();
+            ok = false;
+            std::cout << "No error thrown" << std::endl;
+        }
+        catch (const kafe::internal::ParseError& e)
+        {
+            std::ostringstream os;
+            os << e.row << ":" << e.col << " " << e.what() << "\n";
+            if (os.str() != firstError)
+            {
+                ok = false;
+                std::cout << "Wrong error thrown: " << os.str() << std::endl;
+            }
+        }
+
+        // the collect mode stops on the same error, without throwing
+        try
+        {
+            auto collect = kafe::Parser::fromFile(file);
+            collect.setErrorMode(kafe::Parser::ErrorMode::Collect);
+            collect.parse();
+            if (diagnosticsToString(collect) != firstError)
+            {
+                ok = false;
+                std::cout << "Wrong diagnostics in collect mode:\n" << diagnosticsToString(collect) << std::endl;
+            }
+        }
+        catch (const kafe::internal::ParseError& e)
+        {
+            ok = false;
+            std::cout << "Collect mode threw: " << e.what() << std::endl;
+        }
+
+        // the recover mode finds all the errors and keeps the rest
+        auto recover = kafe::Parser::fromFile(file);
+        recover.setErrorMode(kafe::Parser::ErrorMode::Recover);
+        try
+        {
+            recover.parse();
+        }
+        catch (const kafe::internal::ParseError& e)
+        {
+            ok = false;
+            std::cout << "Recover mode threw: " << e.what() << std::endl;
+        }
+
+        std::ostringstream os;
+        recover.ASTtoString(os);
+        auto content = readFile(file + ".expected");
+        if (diagnosticsToString(recover) != wanted)
+        {
+            ok = false;
+            std::cout << "Wrong diagnostics in recover mode:\n" << diagnosticsToString(recover) << "===========================\n" << wanted << std::endl;
+        }
+
+        if (ok && deepCompareString(os.str(), content) && os.str().size() == content.size())
             ++passed;
         else
         {
@@ -78,6 +309,194 @@ int main()
         ++i;
     }
 
+    // all the files parsed together must give the same ASTs, whatever the number of threads
+    std::cout << "Test 'project' (" << i << ")" << std::endl;
+    bool projectOk = true;
+    for (std::size_t threads : { 1, 4 })
+    {
+        auto project = kafe::Project::fromDirectory("./kafe/");
+        project.setThreads(threads);
+        project.setErrorMode(kafe::Parser::ErrorMode::Collect);
+        project.parse();
+
+        projectOk = projectOk && project.size() == asts.size();
+        for (std::size_t f = 0; f < project.size(); ++f)
+        {
+            std::ostringstream projectOs;
+            project.getParser(f).ASTtoString(projectOs);
+            if (projectOs.str() != asts[project.getPath(f)])
+            {
+                projectOk = false;
+                std::cout << "Project gave a different AST for '" << project.getPath(f) << "'" << std::endl;
+            }
+        }
+    }
+
+    if (projectOk)
+        ++passed;
+    else
+    {
+        ++failed;
+        std::cout << "Test 'project' (" << i << ") failed" << std::endl;
+    }
+    ++i;
+
+    // streaming must free the string literals with the instructions, only the names are kept
+    std::cout << "Test 'streaming' (" << i << ")" << std::endl;
+    bool streamingOk = true;
+    {
+        std::string code;
+        for (std::size_t n = 0; n < 1000; ++n)
+            code += "print(\"line " + std::to_string(n) + "\")\n";
+
+        kafe::Parser p(code);
+        std::size_t count = 0;
+        p.parse([&](kafe::internal::Program& program, kafe::internal::NodeRef inst) {
+            std::ostringstream os;
+            program.toString(inst, os, 0);
+            streamingOk = streamingOk && os.str().find("\"line " + std::to_string(count) + "\"") != std::string::npos;
+            ++count;
+        });
+        streamingOk = streamingOk && count == 1000 && p.getProgram().symbols.size() < 10;
+    }
+
+    if (streamingOk)
+        ++passed;
+    else
+    {
+        ++failed;
+        std::cout << "Test 'streaming' (" << i << ") failed" << std::endl;
+    }
+    ++i;
+
+    // editing the same line again and again mustn't fill the memory with the replaced instructions
+    std::cout << "Test 'reparse' (" << i << ")" << std::endl;
+    bool reparseOk = true;
+    {
+        std::string codes[2] = { readFile("./kafe/calls.kafe"), "" };
+        std::size_t offset = codes[0].find("x += 4");
+        codes[1] = codes[0];
+        codes[1][offset + 5] = '5';
+
+        kafe::Parser p(codes[0]);
+        p.parse();
+        std::size_t size = p.getProgram().size();
+
+        for (std::size_t n = 1; n <= 100 && reparseOk; ++n)
+        {
+            p.reparse(codes[n % 2], { static_cast<std::uint32_t>(offset + 5), 1, 1 });
+            reparseOk = p.getProgram().size() < 2 * size;
+        }
+
+        std::ostringstream os;
+        p.ASTtoString(os);
+        reparseOk = reparseOk && os.str() == asts["./kafe/calls.kafe"];
+    }
+
+    if (reparseOk)
+        ++passed;
+    else
+    {
+        ++failed;
+        std::cout << "Test 'reparse' (" << i << ") failed" << std::endl;
+    }
+    ++i;
+
+    // a code big enough to be split between threads must give the same AST and errors as a single thread
+    std::cout << "Test 'parallel' (" << i << ")" << std::endl;
+    bool parallelOk = true;
+    {
+        std::string block = readFile("./kafe/calls.kafe") + "\n";
+        std::string code;
+        for (std::size_t n = 0; n < 200; ++n)
+            code += block;
+        // the same with an error in the middle of the code
+        std::string broken = code.substr(0, code.size() / 2) + "\nx: = 1\n" + code.substr(code.size() / 2);
+
+        for (const std::string& c : { code, broken })
+        {
+            std::string asts[2];
+            std::string diagnostics[2];
+            for (std::size_t threads : { 1, 4 })
+            {
+                kafe::Parser p(c);
+                p.setThreads(threads);
+                p.setErrorMode(kafe::Parser::ErrorMode::Collect);
+                p.parse();
+
+                std::ostringstream os;
+                p.ASTtoString(os);
+                asts[threads == 1 ? 0 : 1] = os.str();
+                diagnostics[threads == 1 ? 0 : 1] = diagnosticsToString(p);
+            }
+
+            // the error must be found, whatever the mode
+            if (asts[0] != asts[1] || diagnostics[0] != diagnostics[1] || diagnostics[0].empty() != (c == code))
+            {
+                parallelOk = false;
+                std::cout << "Parallel mode gave a different " << (asts[0] != asts[1] ? "AST" : "diagnostics") << std::endl;
+            }
+        }
+    }
+
+    if (parallelOk)
+        ++passed;
+    else
+    {
+        ++failed;
+        std::cout << "Test 'parallel' (" << i << ") failed" << std::endl;
+    }
+    ++i;
+
+    // calling the functions of a file from C++
+    std::cout << "Test 'embedding' (" << i << ")" << std::endl;
+    bool embeddingOk = false;
+    try
+    {
+        auto p = kafe::Parser::fromFile("./kafe/calls.kafe");
+        p.parse();
+
+        // loaded from a compiled file, which is mapped in memory
+        auto compiled = std::filesystem::temp_directory_path() / "kafe_calls.kafec";
+        {
+            auto bytecode = p.generateBytecode();
+            std::ofstream f(compiled, std::ios::binary);
+            f.write(reinterpret_cast<const char*>(bytecode.data()), static_cast<std::streamsize>(bytecode.size()));
+        }
+
+        std::ostringstream output;
+        kafe::VM vm;
+        vm.setOutput(output);
+        vm.feedFile(compiled.string());
+        vm.exec();
+
+        kafe::VM::Handle fib = vm.getHandle("fib");
+        embeddingOk = vm.get<int>("x") == 10 && vm.call<std::int64_t>(fib, 20) == 6765 && vm.call<int>(fib, 10) == 55 &&
+            vm.call<std::string>("greet", "you") == "hello you" && vm.call<std::string>("sign", 2.5) == "positive";
+
+        // a result of the wrong type
+        try
+        {
+            vm.call<int>("greet", "you");
+            embeddingOk = false;
+        }
+        catch (const kafe::internal::RuntimeError&)
+        {}
+    }
+    catch (const std::runtime_error& e)
+    {
+        std::cout << "Error: " << e.what() << std::endl;
+    }
+
+    if (embeddingOk)
+        ++passed;
+    else
+    {
+        ++failed;
+        std::cout << "Test 'embedding' (" << i << ") failed" << std::endl;
+    }
+    ++i;
+
     std::cout << std::endl << std::endl
         << "Tests passed: " << passed << "/" << i << std::endl
         << "Tests failed: " << failed << "/" << i << std::endl;